@@ -0,0 +1,191 @@
+# Benchmarks I18nema against I18n::Backend::Simple on synthetic corpora,
+# and writes the results as JSON (see `rake bench`). Each corpus/backend
+# pair runs in its own process, so RSS and GC numbers don't bleed over.
+#
+# Options come from the environment:
+#
+#   CORPORA   comma separated sizes from Bench::Corpus::SIZES (small,medium)
+#   BACKENDS  i18nema and/or simple (i18nema,simple)
+#   SAMPLES   lookups per key depth (2000)
+#   OUTPUT    where to write the JSON (bench/results/<commit>.json)
+
+$LOAD_PATH.unshift File.expand_path('../../lib', __FILE__)
+require 'i18nema'
+require 'json'
+require 'fileutils'
+require File.expand_path('../corpus', __FILE__)
+
+module Bench
+  BACKENDS = {
+    "i18nema" => lambda { I18nema::Backend.new },
+    "simple"  => lambda { I18n::Backend::Simple.new }
+  }
+
+  class Runner
+    def initialize(options = {})
+      @corpora = options[:corpora] || [:small, :medium]
+      @backends = options[:backends] || BACKENDS.keys
+      @samples = options[:samples] || 2000
+    end
+
+    def run
+      results = {meta: meta, corpora: {}}
+      @corpora.each do |size|
+        corpus = Corpus.new(Corpus::SIZES.fetch(size))
+        results[:corpora][size] = {
+          options: corpus.options,
+          bytes: corpus.bytes,
+          keys: corpus.keys.size,
+          backends: Hash[@backends.map { |name| [name, isolated { measure(corpus, name) }] }]
+        }
+      end
+      results
+    end
+
+    private
+
+    def meta
+      {
+        ruby: RUBY_DESCRIPTION,
+        i18n: defined?(I18n::VERSION) ? I18n::VERSION : nil,
+        commit: commit,
+        time: Time.now.utc.strftime("%Y-%m-%dT%H:%M:%SZ"),
+        samples: @samples
+      }
+    end
+
+    def commit
+      sha = `git rev-parse --short HEAD 2>/dev/null`.strip
+      sha.empty? ? nil : sha
+    end
+
+    def isolated
+      return yield unless Process.respond_to?(:fork)
+      reader, writer = IO.pipe
+      pid = fork do
+        reader.close
+        writer.write(JSON.generate(yield))
+        writer.close
+        exit!(0)
+      end
+      writer.close
+      result = JSON.parse(reader.read, symbolize_names: true)
+      reader.close
+      Process.wait(pid)
+      result
+    end
+
+    def measure(corpus, name)
+      GC.start
+      rss_before = rss
+      backend = BACKENDS.fetch(name).call
+      result = {load: measure_load(backend, corpus)}
+      GC.start
+      result[:rss] = {before: rss_before, after: rss, delta: rss && rss_before && rss - rss_before}
+      result[:gc] = measure_gc
+
+      operations = {lookup: lambda { |locale, key| backend.send(:lookup, locale, key[:key]) },
+                    translate: lambda { |locale, key| backend.translate(locale, key[:key], key[:options]) }}
+      if backend.respond_to?(:direct_lookup)
+        operations[:direct_lookup] = lambda { |locale, key| backend.direct_lookup(locale, *key[:parts]) }
+      end
+      result[:operations] = Hash[operations.map { |operation, block|
+        [operation, Hash[corpus.depths.map { |depth| [depth, measure_operation(corpus, depth, &block)] }]]
+      }]
+      result
+    end
+
+    def measure_load(backend, corpus)
+      started = now
+      corpus.yml.each_value do |yml|
+        if backend.respond_to?(:load_yml_string)
+          backend.load_yml_string(yml)
+        else
+          YAML.load(yml).each { |locale, data| backend.store_translations(locale, data) }
+        end
+      end
+      seconds = now - started
+      {seconds: seconds, bytes: corpus.bytes, mb_per_sec: corpus.bytes / seconds / 1024 / 1024}
+    end
+
+    # full GCs with the translations loaded, which is where keeping them
+    # out of the ruby heap pays off
+    def measure_gc
+      times = Array.new(5) { started = now; GC.start; now - started }
+      {full_gc_ms: median(times) * 1000, heap_live_slots: GC.stat[:heap_live_slots]}
+    end
+
+    def measure_operation(corpus, depth)
+      locales = corpus.locales
+      keys = corpus.sample(depth, @samples).each_with_index.map do |key, i|
+        [locales[i % locales.size], key.merge(parts: key[:key].split("."))]
+      end
+      keys.each { |locale, key| yield locale, key } # warm up
+
+      allocated = GC.stat(:total_allocated_objects)
+      gc_time = GC.stat[:time]
+      keys.each { |locale, key| yield locale, key }
+      allocations = GC.stat(:total_allocated_objects) - allocated
+      gc_ms = gc_time && GC.stat[:time] - gc_time
+
+      latencies = keys.map do |locale, key|
+        started = Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+        yield locale, key
+        Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond) - started
+      end.sort
+      {
+        samples: keys.size,
+        p50_ns: percentile(latencies, 50),
+        p90_ns: percentile(latencies, 90),
+        p99_ns: percentile(latencies, 99),
+        max_ns: latencies.last,
+        allocations_per_op: allocations.to_f / keys.size,
+        gc_ms: gc_ms
+      }
+    end
+
+    def percentile(sorted, pct)
+      sorted[[(sorted.size * pct / 100.0).ceil - 1, 0].max]
+    end
+
+    def median(values)
+      values.sort[values.size / 2]
+    end
+
+    def now
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+
+    def rss
+      status = File.read("/proc/self/status") rescue nil
+      status && status[/^VmRSS:\s+(\d+)/, 1].to_i * 1024
+    end
+  end
+
+  def self.summarize(results)
+    results[:corpora].each do |size, corpus|
+      puts "#{size}: #{corpus[:options][:locales]} locale(s), #{corpus[:keys]} keys, #{corpus[:bytes]} bytes"
+      corpus[:backends].each do |name, result|
+        puts format("  %-8s load %7.2f MB/s  rss +%6.1f MB  full gc %6.2f ms",
+                    name, result[:load][:mb_per_sec], (result[:rss][:delta] || 0) / 1048576.0, result[:gc][:full_gc_ms])
+        result[:operations].each do |operation, depths|
+          p50s = depths.map { |depth, stats| "#{depth}:#{stats[:p50_ns]}" }.join(" ")
+          puts format("    %-14s p50 ns by depth %s", operation, p50s)
+        end
+      end
+    end
+  end
+end
+
+if __FILE__ == $0
+  options = {}
+  options[:corpora] = ENV['CORPORA'].split(",").map(&:to_sym) if ENV['CORPORA']
+  options[:backends] = ENV['BACKENDS'].split(",") if ENV['BACKENDS']
+  options[:samples] = ENV['SAMPLES'].to_i if ENV['SAMPLES']
+  results = Bench::Runner.new(options).run
+  output = ENV['OUTPUT'] || File.expand_path("../results/#{results[:meta][:commit] || 'latest'}.json", __FILE__)
+  FileUtils.mkdir_p(File.dirname(output))
+  File.write(output, JSON.pretty_generate(results))
+  Bench.summarize(results)
+  puts "results written to #{output}"
+end
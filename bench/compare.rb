@@ -0,0 +1,33 @@
+# Compares two `rake bench` runs, e.g. before and after a change:
+#
+#   ruby bench/compare.rb bench/results/abc123.json bench/results/def456.json
+
+require 'json'
+
+base, head = ARGV.map { |path| JSON.parse(File.read(path), symbolize_names: true) }
+abort "usage: #{$0} BASE.json HEAD.json" unless base && head
+
+def change(before, after)
+  return "n/a" unless before && after && before != 0
+  format("%+.1f%%", (after - before) * 100.0 / before)
+end
+
+puts "#{base[:meta][:commit]} -> #{head[:meta][:commit]}"
+head[:corpora].each do |size, corpus|
+  base_corpus = base[:corpora][size] or next
+  corpus[:backends].each do |name, result|
+    before = base_corpus[:backends][name] or next
+    puts "#{size} #{name}"
+    puts format("  %-24s %s", "load MB/s", change(before[:load][:mb_per_sec], result[:load][:mb_per_sec]))
+    puts format("  %-24s %s", "rss delta", change(before[:rss][:delta], result[:rss][:delta]))
+    puts format("  %-24s %s", "full gc", change(before[:gc][:full_gc_ms], result[:gc][:full_gc_ms]))
+    result[:operations].each do |operation, depths|
+      depths.each do |depth, stats|
+        old = before[:operations][operation] && before[:operations][operation][depth] or next
+        puts format("  %-24s p50 %s  p99 %s  allocs %s", "#{operation}(#{depth})",
+                    change(old[:p50_ns], stats[:p50_ns]), change(old[:p99_ns], stats[:p99_ns]),
+                    change(old[:allocations_per_op], stats[:allocations_per_op]))
+      end
+    end
+  end
+end
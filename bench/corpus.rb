@@ -0,0 +1,100 @@
+require 'yaml'
+
+module Bench
+  # Deterministic synthetic translations. The same options (and seed)
+  # always give the same yml, so results are comparable between commits.
+  class Corpus
+    WORDS = %w{
+      account action activity address admin alert archive assignment
+      attachment button calendar cancel comment confirm content course
+      dashboard date default delete description dialog discussion document
+      download edit email error event file filter folder form grade group
+      header help history home image import invite item label language
+      link list login message module name notice option page password
+      people permission preview profile question quiz recent report
+      result role save search section setting status student submit
+      summary title upload user view warning
+    }
+
+    SIZES = {
+      small:  {locales: 1,  keys: 1_000},
+      medium: {locales: 5,  keys: 10_000},
+      large:  {locales: 20, keys: 100_000}
+    }
+
+    DEFAULTS = {
+      locales: 1,
+      keys: 1_000,         # leaves per locale
+      max_depth: 5,        # key parts, locale excluded
+      interpolation: 0.3,  # fraction of strings with %{placeholders}
+      plurals: 0.05,       # fraction of leaves that are plural hashes
+      seed: 1234
+    }
+
+    attr_reader :options, :keys
+
+    def initialize(options = {})
+      @options = DEFAULTS.merge(options)
+      @keys = []
+      generate
+    end
+
+    def locales
+      @yml.keys
+    end
+
+    # locale => yml string
+    def yml
+      @yml
+    end
+
+    def bytes
+      @yml.values.inject(0) { |sum, yml| sum + yml.bytesize }
+    end
+
+    # a deterministic sample of keys with the given number of parts, each
+    # as [key, options] for translate
+    def sample(depth, count)
+      candidates = @keys.select { |key| key[:depth] == depth }
+      return [] if candidates.empty?
+      random = Random.new(@options[:seed] + depth)
+      Array.new(count) { candidates[random.rand(candidates.size)] }
+    end
+
+    def depths
+      @keys.map { |key| key[:depth] }.uniq.sort
+    end
+
+    private
+
+    def generate
+      random = Random.new(@options[:seed])
+      tree = {}
+      @options[:keys].times do |i|
+        depth = 1 + random.rand(@options[:max_depth])
+        path = Array.new(depth - 1) { WORDS[random.rand(WORDS.size)] }
+        path << "#{WORDS[random.rand(WORDS.size)]}_#{i}"
+        # leaf names are unique, so they never collide with a branch
+        parent = path[0...-1].inject(tree) { |node, part| node[part] ||= {} }
+        if random.rand < @options[:plurals]
+          parent[path.last] = {"one" => "one #{phrase(random, 1)}", "other" => "%{count} #{phrase(random, 2)}"}
+          @keys << {key: path.join("."), depth: depth, options: {count: 1 + random.rand(5)}}
+        else
+          interpolated = random.rand < @options[:interpolation]
+          parent[path.last] = interpolated ? "#{phrase(random, 2)} %{name} #{phrase(random, 2)}" : phrase(random, 1 + random.rand(6))
+          @keys << {key: path.join("."), depth: depth, options: interpolated ? {name: "Bob"} : {}}
+        end
+      end
+
+      @yml = {}
+      @options[:locales].times do |i|
+        locale = i == 0 ? "en" : "l#{i}"
+        @yml[locale] = YAML.dump(locale => tree)
+      end
+    end
+
+    def phrase(random, words)
+      Array.new(words) { WORDS[random.rand(WORDS.size)] }.join(" ")
+    end
+  end
+end
@@ -1,5 +1,17 @@
 require 'mkmf'
 dir_config "i18nema/i18nema"
 have_header "st.h"
+have_header "sys/mman.h"
+have_header "ruby/thread.h"
+have_header "ruby/ractor.h"
+have_header "ruby/thread_native.h"
+have_struct_member "struct stat", "st_mtim", "sys/stat.h"
+have_struct_member "struct stat", "st_mtimespec", "sys/stat.h"
+have_library "z", "compress2", "zlib.h"
+have_func "rb_enc_interned_str", "ruby.h"
+have_func "rb_sym2str", "ruby.h"
+have_func "rb_ext_ractor_safe", "ruby.h"
+have_func "rb_ractor_local_storage_value_newkey", ["ruby.h", "ruby/ractor.h"]
+have_func "rb_ractor_make_shareable", ["ruby.h", "ruby/ractor.h"]
 $CFLAGS << " -std=c99"
 create_makefile 'i18nema/i18nema'
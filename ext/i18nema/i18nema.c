@@ -1,9 +1,70 @@
 #include <ruby.h>
 #include <ruby/encoding.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_RUBY_THREAD_H
+#include <ruby/thread.h>
+#endif
+#ifdef HAVE_RUBY_RACTOR_H
+#include <ruby/ractor.h>
+#endif
+#ifdef HAVE_RUBY_THREAD_NATIVE_H
+#include <ruby/thread_native.h>
+#endif
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef STATIC_SYM_P
+#define I_STATIC_SYM_P(sym) STATIC_SYM_P(sym)
+#else
+#define I_STATIC_SYM_P(sym) SYMBOL_P(sym) // no dynamic symbols before 2.2
+#endif
 #include "vendor/syck.h"
+
+#if defined(__GNUC__)
+#define I_THREAD_LOCAL __thread
+#else
+#define I_THREAD_LOCAL
+#endif
+
+// hash tables for translations live in the arena of whatever load is
+// currently building them; everything else (e.g. the key cache) is malloced
+static void *arena_uthash_malloc(size_t size);
+static void arena_uthash_free(void *ptr, size_t size);
+#define uthash_malloc(sz) arena_uthash_malloc(sz)
+#define uthash_free(ptr, sz) arena_uthash_free(ptr, sz)
 #include "vendor/uthash.h"
 
-#define CAN_FREE(item) item != NULL && item->type != i_type_true && item->type != i_type_false && item->type != i_type_null
+#define CAN_FREE(item) ((item) != NULL && (item)->type != i_type_true && (item)->type != i_type_false && (item)->type != i_type_null)
+#define I_ARENA_ALIGN sizeof(void *)
+#define I_ARENA_MIN_CHUNK_SIZE 4096
+#define I_ARENA_MAX_CHUNK_SIZE (1024 * 1024)
+#define I_FNV_OFFSET 14695981039346656037ULL
+#define I_FNV_PRIME 1099511628211ULL
+#define I_PATH_SEPARATOR 0xff // can't appear in utf-8, so paths can't collide by concatenation
+#define I_SNAPSHOT_MAGIC "I18NEMA"
+#define I_SNAPSHOT_VERSION 1
+#define I_SNAPSHOT_ENDIAN 0x01020304
+#define I_SNAPSHOT_SLOT 0x40000000u // rstring_slot flag: the rest is a snapshot node index
+#define I_LOOKUP_STACK_PARTS 16
+#define I_TEMPLATE_STACK_VALUES 16
+#define I_KEY_CACHE_MAX_ENTRIES 100000
+#define I_YML_MAX_DEPTH 256
+#define I_JSON_CHUNK_SIZE 16384
+#define I_LINK_MAX_DEPTH 64
+#define I_PROFILE_MAX_MISSES 4096
+#define I_POOL_SHARDS 16
+#define SNAPSHOT_AT(base, offset) ((char *)(base) + (offset))
+#ifndef RUBY_TYPED_FREE_IMMEDIATELY
+#define RUBY_TYPED_FREE_IMMEDIATELY 0
+#endif
 
 VALUE I18nema = Qnil,
       I18nemaBackend = Qnil,
@@ -11,13 +72,28 @@ VALUE I18nema = Qnil,
 
 struct i_object;
 struct i_key_value;
-static VALUE array_to_rarray(struct i_object *array);
-static VALUE hash_to_rhash(struct i_object *hash);
+struct i_translations;
+struct i_snapshot_node;
+struct i_cold_locale;
+static VALUE array_to_rarray(struct i_object *array, struct i_translations *store);
+static VALUE hash_to_rhash(struct i_object *hash, struct i_translations *store);
+static VALUE snapshot_array_to_rarray(const struct i_snapshot_node *array, struct i_translations *store);
+static VALUE snapshot_hash_to_rhash(const struct i_snapshot_node *hash, struct i_translations *store);
 static void merge_hash(struct i_object *hash, struct i_object *other_hash);
 static void delete_hash(struct i_key_value **hash, int recurse);
 static void delete_object(struct i_object *object, int recurse);
 static void delete_object_r(struct i_object *object);
+static void thaw_snapshot(struct i_translations *store);
+static char *build_snapshot(struct i_object *root, const char *fingerprint, size_t fingerprint_size);
+static void touch_cold_locale(struct i_translations *store, VALUE locale);
+static void warm_cold_locale(struct i_translations *store, struct i_cold_locale *cold);
+static void warm_cold_locales(struct i_translations *store);
+static void clear_cold_locales(struct i_translations *store);
+static void intern_template_names(struct i_object *object);
 static VALUE normalize_key(VALUE self, VALUE key, VALUE separator);
+static void load_reserved_keys(void);
+static const rb_data_type_t i_translations_type;
+static const rb_data_type_t i_key_cache_type;
 
 enum i_object_type {
   i_type_unused,
@@ -29,22 +105,57 @@ enum i_object_type {
   i_type_symbol,
   i_type_true,
   i_type_false,
-  i_type_null
+  i_type_null,
+  // only used for transient views of snapshot nodes, never persisted
+  i_type_snapshot_array,
+  i_type_snapshot_hash
 };
 
 union i_object_data {
   char *string;
   struct i_object *array;
   struct i_key_value *hash;
+  const struct i_snapshot_node *snapshot;
 };
 
 typedef struct i_object
 {
   unsigned long size;
   enum i_object_type type;
+  unsigned int rstring_slot : 31; // 1-based index into the string cache, 0 if not cached
+  unsigned int templated : 1; // string is preceded by a pointer to its i_template_t
+  // (symbols are always preceded by a pointer to their link target, see resolve_links=)
   union i_object_data data;
 } i_object_t;
 
+enum i_segment_type {
+  i_segment_literal,
+  i_segment_placeholder, // %{name}
+  i_segment_format       // %<name>format
+};
+
+typedef struct i_template_segment
+{
+  enum i_segment_type type;
+  unsigned long offset; // literal text, or placeholder name
+  unsigned long len;
+  unsigned long format_offset; // sprintf directive sans %, for i_segment_format
+  unsigned long format_len;
+  ID name; // interned on first use
+} i_template_segment_t;
+
+/*
+ * A string with interpolations, pre-tokenized into literal and placeholder
+ * segments (offsets are relative to the string)
+ */
+typedef struct i_template
+{
+  unsigned long num_segments;
+  unsigned long num_placeholders;
+  unsigned long literal_size;
+  i_template_segment_t segments[];
+} i_template_t;
+
 typedef struct i_key_value
 {
   char *key;
@@ -52,27 +163,671 @@ typedef struct i_key_value
   UT_hash_handle hh;
 } i_key_value_t;
 
-static int current_translation_count = 0;
+typedef struct i_arena_chunk
+{
+  struct i_arena_chunk *next;
+  size_t size;
+  size_t used;
+  char data[];
+} i_arena_chunk_t;
+
+/*
+ * Bump allocator backing a single load. Nodes, key/values, strings and
+ * hash tables are carved out of chunks and never freed individually;
+ * the whole arena goes away at once on reload! (or when the load fails).
+ */
+typedef struct i_arena
+{
+  struct i_arena *next;
+  i_arena_chunk_t *chunks;
+  i_object_t *recycled; // shells the parsers are done with
+  size_t next_chunk_size;
+  unsigned long num_chunks;
+  size_t allocated;
+  size_t used;
+} i_arena_t;
+
+/*
+ * A single part of a lookup path; not necessarily NUL-terminated
+ */
+typedef struct i_key_part
+{
+  const char *key;
+  unsigned long len;
+} i_key_part_t;
+
+typedef struct i_path_entry
+{
+  uint64_t hash;
+  const char *path; // NUL-separated key parts
+  unsigned long path_len;
+  i_object_t *object;
+} i_path_entry_t;
+
+/*
+ * Optional flat index of every full path (locale included) in the
+ * translation tree, so that direct_lookup is a single probe instead of
+ * one uthash lookup per key part. Open addressing with linear probing.
+ */
+typedef struct i_path_index
+{
+  int enabled;
+  int stale;
+  i_path_entry_t *entries;
+  unsigned long capacity; // power of two
+  unsigned long count;
+  i_arena_t *paths;
+} i_path_index_t;
+
+typedef struct i_profile_entry
+{
+  uint64_t hash; // of the full path, as for the path index
+  unsigned long count; // 0 if the slot is free
+  char *key; // dot-separated path, for misses only
+} i_profile_entry_t;
+
+/*
+ * Sampled lookup counts for key_profile: every rate-th lookup bumps the
+ * count for its full path, or records it as missing. Misses are capped,
+ * since anything can be looked up.
+ */
+typedef struct i_key_profile
+{
+  unsigned long rate; // 0 when off
+  unsigned long countdown;
+  unsigned long samples;
+  i_profile_entry_t *hits;
+  unsigned long hits_capacity; // power of two
+  unsigned long num_hits;
+  i_profile_entry_t *misses; // I_PROFILE_MAX_MISSES * 2 slots
+  unsigned long num_misses;
+  unsigned long dropped_misses;
+} i_key_profile_t;
+
+typedef struct i_cached_string
+{
+  i_object_t *object;
+  VALUE rstring;
+} i_cached_string_t;
+
+/*
+ * When enabled, each string leaf lazily gets a frozen, deduplicated ruby
+ * string that is handed out on every lookup, so hits don't allocate
+ */
+typedef struct i_string_cache
+{
+  int enabled;
+  i_cached_string_t *entries;
+  unsigned long count;
+  unsigned long capacity;
+  unsigned long free_slot; // first slot released by release_cached_rstrings (0 for none), chained through their rstrings
+  unsigned long num_free;
+  unsigned int *snapshot_slots; // per snapshot node, since views are transient
+} i_string_cache_t;
+
+typedef struct i_pool_entry
+{
+  char *str; // NULL if the slot is free
+  unsigned long len;
+  uint64_t hash;
+  int templated;
+} i_pool_entry_t;
+
+/*
+ * A slice of the string pool, with its own lock (loads parse on several
+ * threads at once) and arena
+ */
+typedef struct i_pool_shard
+{
+  i_pool_entry_t *entries;
+  unsigned long capacity; // power of two
+  unsigned long count;
+  i_arena_t *arena;
+  unsigned long hits;
+  unsigned long misses;
+  size_t saved; // bytes that would have been copied, were it not for hits
+#ifdef HAVE_RUBY_THREAD_NATIVE_H
+  rb_nativethread_lock_t lock;
+#endif
+} i_pool_shard_t;
+
+/*
+ * When enabled, loads intern keys and scalars here, so each distinct
+ * string (and its template, if any) is stored once for the whole store,
+ * rather than once per occurrence. Pooled strings are never freed
+ * individually; like everything else in the arenas, they go away on
+ * reload! (string_pool_stats reports the ones that are orphaned until
+ * then).
+ */
+typedef struct i_string_pool
+{
+  int enabled;
+  i_pool_shard_t shards[I_POOL_SHARDS];
+} i_string_pool_t;
+
+typedef struct i_key_cache_entry
+{
+  struct i_key_cache_map *map;
+  char *key; // NULL if keyed by symbol
+  unsigned long key_len;
+  ID symbol;
+  i_object_t *parts;
+  size_t bytes;
+  unsigned long slot; // in the clock
+  int referenced;
+  UT_hash_handle hh;
+} i_key_cache_entry_t;
+
+typedef struct i_key_cache_map
+{
+  char *separator;
+  i_key_cache_entry_t *strings;
+  i_key_cache_entry_t *symbols; // static ones only, since dynamic symbols can be collected
+  UT_hash_handle hh;
+} i_key_cache_map_t;
+
+/*
+ * Normalized (split) keys per separator, keyed by string or Symbol ID.
+ * Bounded by entry count and/or bytes, evicting with the CLOCK algorithm.
+ * Eviction only happens once a lookup is done with its parts, so they
+ * stay valid for as long as it needs them.
+ */
+typedef struct i_key_cache
+{
+  i_key_cache_map_t *maps; // by separator
+  i_key_cache_entry_t **clock;
+  unsigned long count;
+  unsigned long capacity;
+  unsigned long hand;
+  unsigned long max_entries; // 0 for no limit
+  size_t bytes;
+  size_t max_bytes; // 0 for no limit
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+} i_key_cache_t;
+
+/*
+ * State for a single parse, hung off parser->bonus
+ */
+typedef struct i_parse
+{
+  i_arena_t *arena;
+  int translation_count;
+  int raise; // rb_raise on errors, rather than just flagging them (i.e. we have the GVL)
+  int failed;
+  i_string_pool_t *pool; // if strings should be interned
+} i_parse_t;
+
+/*
+ * State for read_yml. Anything it doesn't handle longjmps to bail, and the
+ * parse starts over with syck.
+ */
+typedef struct i_yml_reader
+{
+  i_parse_t *parse;
+  const char *line; // start of the first line not yet consumed
+  const char *end;
+  char *scratch; // for scalars that need unescaping or joining
+  long scratch_len;
+  long scratch_size;
+  i_object_t *items; // pending sequence items, nested sequences on top
+  long num_items;
+  long items_size;
+  i_object_t *root; // here rather than a local, since longjmp clobbers those
+  jmp_buf bail;
+} i_yml_reader_t;
+
+typedef struct i_load_job
+{
+  char *path;
+  struct stat st;
+  i_parse_t parse;
+  i_object_t *root;
+} i_load_job_t;
+
+struct i_load_batch;
+
+typedef struct i_load_worker
+{
+  struct i_load_batch *batch;
+  long index; // does every num_workers-th job, starting with this one
+} i_load_worker_t;
+
+/*
+ * Files for load_yml_files, read and parsed on worker threads without the
+ * GVL, then merged in order. Workers only ever run read_yml; syck has
+ * global state (and calls back into Ruby on errors), so any file it can't
+ * handle gets loaded the usual way afterwards, on the calling thread.
+ */
+typedef struct i_load_batch
+{
+  VALUE self;
+  VALUE paths;
+  VALUE threads;
+  i_load_job_t *jobs;
+  long num_jobs;
+  i_load_worker_t *workers;
+  long num_workers;
+  volatile int cancelled;
+} i_load_batch_t;
+
+typedef const char *(*i_plural_rule_fn)(VALUE count);
+
+/*
+ * Plural rule for a locale: either one of the builtin C rules, or any
+ * callable returning the plural key (like I18n::Backend::Pluralization)
+ */
+typedef struct i_plural_rule
+{
+  char *locale;
+  i_plural_rule_fn fn;
+  VALUE callable;
+  UT_hash_handle hh;
+} i_plural_rule_t;
+
+/*
+ * Where a load's translations came from, so that reload_changed! can tell
+ * what needs re-parsing. A subtree is a locale plus a top level key; all
+ * of the nodes in one live in the arenas of the sources contributing to
+ * it, so it can be rebuilt from just those. The root and locale hashes
+ * have no such owner, and get rebuilt in their own arena (store->spine).
+ */
+typedef struct i_source
+{
+  struct i_source *next; // in load order
+  char *path; // NULL if loaded from a string
+  char *locale; // if set, only this locale was kept (see lazy_locales)
+  char *yml; // otherwise a copy of it, so it can be re-parsed
+  long yml_len;
+  char *tree; // or if loaded from a Hash, a snapshot of it (see build_snapshot)
+  int reparseable; // not the case for thawed snapshots
+  time_t mtime;
+  long mtime_nsec; // 0 if the platform doesn't have them
+  off_t size;
+  i_arena_t *arena;
+  char *subtrees; // NUL-terminated ids ("locale" for each locale, "locale\xffkey" for each subtree)
+  unsigned long num_subtrees;
+
+  // only used during reload_changed!
+  int state;
+  struct stat new_st;
+  i_arena_t *new_arena;
+  i_object_t *new_root;
+  char *new_subtrees;
+  unsigned long num_new_subtrees;
+} i_source_t;
+
+enum i_source_state {
+  i_source_unchanged,
+  i_source_changed,
+  i_source_reparsed,
+  i_source_removed,
+  i_source_failed
+};
+
+typedef struct i_subtree
+{
+  const char *id;
+  UT_hash_handle hh;
+} i_subtree_t;
+
+/*
+ * Snapshots are a position-independent image of the merged translation
+ * tree, so they can be mmapped and used as-is. All offsets are relative
+ * to the struct they appear in. Layout:
+ *
+ *   header | fingerprint | node table | child table | string blob
+ *
+ * The root is the first node. Array items are contiguous in the node
+ * table, as are the children of a hash in the child table (in their
+ * original order, with `sorted` giving the order by hash for lookups).
+ * Strings are NUL-terminated and deduplicated.
+ */
+typedef struct i_snapshot_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t file_size;
+  uint64_t checksum; // of everything after the header
+  uint64_t fingerprint_size;
+  uint64_t node_count;
+  uint64_t child_count;
+  uint64_t nodes_offset;
+  uint64_t children_offset;
+  uint64_t strings_offset;
+} i_snapshot_header_t;
+
+typedef struct i_snapshot_node
+{
+  uint32_t type;
+  uint32_t size; // bytes for scalars, items for arrays, children for hashes
+  int64_t offset; // string, first item, or first child
+} i_snapshot_node_t;
+
+typedef struct i_snapshot_child
+{
+  uint32_t hash;
+  uint32_t key_size;
+  uint32_t sorted;
+  uint32_t unused;
+  int64_t key;
+  int64_t node;
+} i_snapshot_child_t;
+
+typedef struct i_snapshot
+{
+  char *data;
+  size_t size;
+  int mapped;
+  const i_snapshot_node_t *nodes;
+} i_snapshot_t;
+
+/*
+ * A locale whose tree has been swapped out for a deflated snapshot of it
+ * (see compress_locales), until the next lookup in it. With
+ * compress_idle_locales, locales that are in the tree get one too, to
+ * track when they were last looked up.
+ */
+typedef struct i_cold_locale
+{
+  char *locale;
+  char *blob; // NULL while the locale is in the tree
+  size_t blob_size;
+  size_t raw_size; // of the snapshot, before deflating
+  unsigned long last_used; // idle round (see compress_idle_locales)
+  UT_hash_handle hh;
+} i_cold_locale_t;
+
+typedef struct i_translations
+{
+  i_object_t root;
+  i_arena_t *arenas; // one per load, newest first
+  i_snapshot_t *snapshot; // if set, root is a view of its root node
+  i_path_index_t index;
+  i_key_profile_t profile;
+  i_string_cache_t string_cache;
+  i_string_pool_t pool;
+  i_plural_rule_t *plural_rules; // by locale, survives reload!
+  int ruby_plurals; // pluralize is overridden, so only locales with a plural_rule get pluralized in C
+  i_source_t *sources;
+  i_source_t **last_source;
+  i_arena_t *spine; // root and locale hashes, once reload_changed! has rebuilt them
+  int incremental; // whether reload_changed! can work with what's loaded
+  int keep_sources; // copy what store_translations loads, so reload_changed! can merge it again
+  unsigned long generation; // bumped whenever the tree changes
+  int resolve_links; // follow symbol values to their targets on lookup
+  int links_stale; // links get re-resolved on the next lookup
+  int frozen; // see freeze_translations; nothing may change it after that
+  unsigned long key_cache_max_entries; // limits for the per-Ractor key caches, once frozen
+  size_t key_cache_max_bytes;
+  i_cold_locale_t *cold_locales;
+  i_arena_t *cold_spine; // the root hash, as rebuilt by the last compress_locales
+  unsigned long idle_round; // 0 until compress_idle_locales first runs
+} i_translations_t;
+
 static ID s_init_translations,
           s_to_f,
           s_to_s,
-          s_to_sym;
+          s_to_sym,
+          s_call,
+          s_interpolate,
+          s_load_yml,
+          s_join,
+          s_alive_p,
+          s_load_locale,
+          s_pending_locales;
+static VALUE reserved_keys = Qnil;
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+static rb_ractor_local_key_t ractor_key_cache;
+#endif
 static i_object_t i_object_null,
                   i_object_true,
-                  i_object_false;
+                  i_object_false,
+                  i_link_unresolved,
+                  i_link_pending;
+static I_THREAD_LOCAL i_arena_t *uthash_arena = NULL;
+// likewise, the pool (if any) for the parse currently running
+static I_THREAD_LOCAL i_string_pool_t *string_pool = NULL;
+// strings in nodes that a merge overwrites give their cache slots back here
+static I_THREAD_LOCAL i_string_cache_t *merge_string_cache = NULL;
+
+static char *string_pool_intern(i_string_pool_t *pool, char *str, unsigned long len, long num_segments);
+
+static i_arena_chunk_t*
+arena_add_chunk(i_arena_t *arena, size_t min_size)
+{
+  size_t size = arena->next_chunk_size;
+  if (size < min_size)
+    size = min_size;
+  i_arena_chunk_t *chunk = xmalloc(sizeof(i_arena_chunk_t) + size);
+  chunk->size = size;
+  chunk->used = 0;
+  if (arena->chunks != NULL && min_size > arena->next_chunk_size) {
+    // oversized one-off; keep bumping in the current chunk
+    chunk->next = arena->chunks->next;
+    arena->chunks->next = chunk;
+  } else {
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    if (arena->next_chunk_size < I_ARENA_MAX_CHUNK_SIZE)
+      arena->next_chunk_size *= 2;
+  }
+  arena->num_chunks++;
+  arena->allocated += size;
+  return chunk;
+}
+
+static void*
+arena_alloc_aligned(i_arena_t *arena, size_t size, size_t align)
+{
+  i_arena_chunk_t *chunk = arena->chunks;
+  size_t offset = 0;
+  if (chunk != NULL)
+    offset = (chunk->used + align - 1) & ~(align - 1);
+  if (chunk == NULL || offset + size > chunk->size) {
+    chunk = arena_add_chunk(arena, size);
+    offset = chunk->used;
+  }
+  arena->used += size + offset - chunk->used;
+  chunk->used = offset + size;
+  return chunk->data + offset;
+}
+
+static void*
+arena_alloc(i_arena_t *arena, size_t size)
+{
+  return arena_alloc_aligned(arena, size, I_ARENA_ALIGN);
+}
+
+/*
+ * size_hint is roughly how much input this arena is for, so that a
+ * store_translations call with two keys doesn't grab a huge chunk
+ */
+static i_arena_t*
+new_arena(size_t size_hint)
+{
+  i_arena_t *arena = ALLOC(i_arena_t);
+  memset(arena, 0, sizeof(i_arena_t));
+  arena->next_chunk_size = I_ARENA_MIN_CHUNK_SIZE;
+  while (arena->next_chunk_size < size_hint && arena->next_chunk_size < I_ARENA_MAX_CHUNK_SIZE)
+    arena->next_chunk_size *= 2;
+  return arena;
+}
+
+static void
+delete_arena(i_arena_t *arena)
+{
+  i_arena_chunk_t *chunk, *next;
+  for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+    next = chunk->next;
+    xfree(chunk);
+  }
+  xfree(arena);
+}
+
+static void
+delete_arenas(i_arena_t *arena)
+{
+  i_arena_t *next;
+  for (; arena != NULL; arena = next) {
+    next = arena->next;
+    delete_arena(arena);
+  }
+}
+
+static void*
+arena_uthash_malloc(size_t size)
+{
+  if (uthash_arena != NULL)
+    return arena_alloc(uthash_arena, size);
+  return malloc(size);
+}
+
+static void
+arena_uthash_free(void *ptr, size_t size)
+{
+  // arena tables just get dropped; the chunk goes away on reload
+  if (uthash_arena == NULL)
+    free(ptr);
+}
+
+static void*
+i_alloc(i_arena_t *arena, size_t size)
+{
+  return arena == NULL ? xmalloc(size) : arena_alloc(arena, size);
+}
+
+static VALUE
+new_frozen_string(const char *str, long len)
+{
+#ifdef HAVE_RB_ENC_INTERNED_STR
+  return rb_enc_interned_str(str, len, rb_utf8_encoding());
+#else
+  return rb_str_freeze(rb_enc_str_new(str, len, rb_utf8_encoding()));
+#endif
+}
+
+/*
+ * owner is the (persistent) object whose slot this is, or NULL for a
+ * snapshot node
+ */
+static unsigned int
+add_cached_rstring(i_string_cache_t *cache, i_object_t *owner, i_object_t *object)
+{
+  unsigned long slot = cache->free_slot;
+  if (slot != 0) {
+    cache->free_slot = FIX2LONG(cache->entries[slot - 1].rstring);
+    cache->num_free--;
+  } else {
+    if (cache->count == cache->capacity) {
+      cache->capacity = cache->capacity == 0 ? 256 : cache->capacity * 2;
+      REALLOC_N(cache->entries, i_cached_string_t, cache->capacity);
+    }
+    slot = ++cache->count;
+  }
+  cache->entries[slot - 1].object = owner;
+  cache->entries[slot - 1].rstring = new_frozen_string(object->data.string, object->size);
+  return slot;
+}
 
+/*
+ * Gives the slots of the strings under object (which is leaving the tree)
+ * back for reuse, so that overwriting translations doesn't keep growing
+ * the cache
+ */
+static void
+release_cached_rstrings(i_string_cache_t *cache, i_object_t *object)
+{
+  switch (object->type) {
+  case i_type_hash:
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next)
+      release_cached_rstrings(cache, kv->value);
+    break;
+  case i_type_array:
+    for (unsigned long i = 0; i < object->size; i++)
+      release_cached_rstrings(cache, &object->data.array[i]);
+    break;
+  case i_type_string:
+    if (object->rstring_slot != 0) {
+      i_cached_string_t *entry = &cache->entries[object->rstring_slot - 1];
+      entry->object = NULL;
+      entry->rstring = LONG2FIX(cache->free_slot);
+      cache->free_slot = object->rstring_slot;
+      cache->num_free++;
+      object->rstring_slot = 0;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static VALUE
+cached_rstring(i_translations_t *store, i_object_t *object)
+{
+  i_string_cache_t *cache = &store->string_cache;
+  unsigned int slot = object->rstring_slot;
+  if (slot & I_SNAPSHOT_SLOT) {
+    unsigned int *snapshot_slot;
+    if (cache->snapshot_slots == NULL) {
+      const i_snapshot_header_t *header = (i_snapshot_header_t *)store->snapshot->data;
+      cache->snapshot_slots = ALLOC_N(unsigned int, header->node_count);
+      memset(cache->snapshot_slots, 0, sizeof(unsigned int) * header->node_count);
+    }
+    snapshot_slot = &cache->snapshot_slots[slot & ~I_SNAPSHOT_SLOT];
+    if (*snapshot_slot == 0 && !store->frozen)
+      *snapshot_slot = add_cached_rstring(cache, NULL, object);
+    slot = *snapshot_slot;
+  } else if (slot == 0 && !store->frozen) {
+    slot = object->rstring_slot = add_cached_rstring(cache, object, object);
+  }
+  // once frozen, the cache is read-only (Ractors may be reading it)
+  if (slot == 0)
+    return new_frozen_string(object->data.string, object->size);
+  return cache->entries[slot - 1].rstring;
+}
+
+static void
+clear_string_cache(i_string_cache_t *cache, int reset_objects)
+{
+  if (reset_objects)
+    for (unsigned long i = 0; i < cache->count; i++)
+      if (cache->entries[i].object != NULL)
+        cache->entries[i].object->rstring_slot = 0;
+  xfree(cache->entries);
+  xfree(cache->snapshot_slots);
+  cache->entries = NULL;
+  cache->snapshot_slots = NULL;
+  cache->count = 0;
+  cache->capacity = 0;
+  cache->free_slot = 0;
+  cache->num_free = 0;
+}
+
+/*
+ * store is the backend the object lives in, or NULL if it's not part of
+ * the translations (e.g. the normalized key cache)
+ */
 static VALUE
-i_object_to_robject(i_object_t *object) {
+i_object_to_robject(i_object_t *object, i_translations_t *store) {
   VALUE s;
   if (object == NULL)
     return Qnil;
   switch (object->type) {
   case i_type_string:
+    if (store != NULL && store->string_cache.enabled)
+      return cached_rstring(store, object);
     return rb_enc_str_new(object->data.string, object->size, rb_utf8_encoding());
   case i_type_array:
-    return array_to_rarray(object);
+    return array_to_rarray(object, store);
   case i_type_hash:
-    return hash_to_rhash(object);
+    return hash_to_rhash(object, store);
+  case i_type_snapshot_array:
+    return snapshot_array_to_rarray(object->data.snapshot, store);
+  case i_type_snapshot_hash:
+    return snapshot_hash_to_rhash(object->data.snapshot, store);
   case i_type_int:
     return rb_cstr2inum(object->data.string, 10);
   case i_type_float:
@@ -90,488 +845,6133 @@ i_object_to_robject(i_object_t *object) {
 }
 
 static VALUE
-array_to_rarray(i_object_t *array)
+array_to_rarray(i_object_t *array, i_translations_t *store)
 {
   VALUE result = rb_ary_new2(array->size);
   for (unsigned long i = 0; i < array->size; i++)
-    rb_ary_store(result, i, i_object_to_robject(&array->data.array[i]));
+    rb_ary_store(result, i, i_object_to_robject(&array->data.array[i], store));
   return result;
 }
 
 static VALUE
-hash_to_rhash(i_object_t *hash)
+hash_to_rhash(i_object_t *hash, i_translations_t *store)
 {
   i_key_value_t *handle = hash->data.hash;
   VALUE result = rb_hash_new();
   for (; handle != NULL; handle = handle->hh.next)
-    rb_hash_aset(result, ID2SYM(rb_intern(handle->key)), i_object_to_robject(handle->value));
+    rb_hash_aset(result, ID2SYM(rb_intern(handle->key)), i_object_to_robject(handle->value, store));
   return result;
 }
 
 static i_object_t*
-i_object_get(VALUE self, const char *iv)
+snapshot_view(i_translations_t *store, const i_snapshot_node_t *node, i_object_t *view)
 {
-  i_object_t *object;
-  VALUE wrapped;
-  wrapped = rb_iv_get(self, iv);
-  Data_Get_Struct(wrapped, i_object_t, object);
-  return object;
+  switch (node->type) {
+  case i_type_true:
+    return &i_object_true;
+  case i_type_false:
+    return &i_object_false;
+  case i_type_null:
+    return &i_object_null;
+  case i_type_array:
+    view->type = i_type_snapshot_array;
+    view->data.snapshot = node;
+    break;
+  case i_type_hash:
+    view->type = i_type_snapshot_hash;
+    view->data.snapshot = node;
+    break;
+  default:
+    view->type = node->type;
+    view->data.string = SNAPSHOT_AT(node, node->offset);
+    break;
+  }
+  view->size = node->size;
+  view->rstring_slot = I_SNAPSHOT_SLOT | (unsigned int)(node - store->snapshot->nodes);
+  view->templated = 0;
+  return view;
 }
 
-static i_object_t*
-translations_get(VALUE self)
+static VALUE
+snapshot_array_to_rarray(const i_snapshot_node_t *array, i_translations_t *store)
 {
-  return i_object_get(self, "@translations");
+  const i_snapshot_node_t *items = (i_snapshot_node_t *)SNAPSHOT_AT(array, array->offset);
+  VALUE result = rb_ary_new2(array->size);
+  i_object_t view;
+  for (unsigned long i = 0; i < array->size; i++)
+    rb_ary_store(result, i, i_object_to_robject(snapshot_view(store, &items[i], &view), store));
+  return result;
 }
 
-static i_object_t*
-normalized_key_cache_get(VALUE self)
+static VALUE
+snapshot_hash_to_rhash(const i_snapshot_node_t *hash, i_translations_t *store)
 {
-  return i_object_get(self, "@normalized_key_cache");
+  const i_snapshot_child_t *children = (i_snapshot_child_t *)SNAPSHOT_AT(hash, hash->offset);
+  VALUE result = rb_hash_new();
+  i_object_t view;
+  for (unsigned long i = 0; i < hash->size; i++) {
+    const i_snapshot_child_t *child = &children[i];
+    const i_snapshot_node_t *node = (i_snapshot_node_t *)SNAPSHOT_AT(child, child->node);
+    rb_hash_aset(result, ID2SYM(rb_intern(SNAPSHOT_AT(child, child->key))), i_object_to_robject(snapshot_view(store, node, &view), store));
+  }
+  return result;
+}
+
+static uint32_t
+snapshot_key_hash(const char *key, unsigned long len)
+{
+  uint32_t hash = 2166136261u;
+  for (unsigned long i = 0; i < len; i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static const i_snapshot_node_t*
+snapshot_find_child(const i_snapshot_node_t *hash, const char *key, unsigned long len)
+{
+  const i_snapshot_child_t *children = (i_snapshot_child_t *)SNAPSHOT_AT(hash, hash->offset);
+  uint32_t key_hash = snapshot_key_hash(key, len);
+  unsigned long lo = 0, hi = hash->size;
+  while (lo < hi) {
+    unsigned long mid = lo + (hi - lo) / 2;
+    if (children[children[mid].sorted].hash < key_hash)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  for (; lo < hash->size && children[children[lo].sorted].hash == key_hash; lo++) {
+    const i_snapshot_child_t *child = &children[children[lo].sorted];
+    if (child->key_size == len && memcmp(SNAPSHOT_AT(child, child->key), key, len) == 0)
+      return (i_snapshot_node_t *)SNAPSHOT_AT(child, child->node);
+  }
+  return NULL;
 }
 
 static i_object_t*
-hash_get(i_object_t *current, VALUE *keys, int num_keys)
+snapshot_get_under(i_translations_t *store, const i_snapshot_node_t *current, i_key_part_t *parts, long num_parts, i_object_t *view)
 {
-  i_key_value_t *kv = NULL;
-  for (int i = 0; i < num_keys && current != NULL && current->type == i_type_hash; i++) {
-    Check_Type(keys[i], T_STRING);
-    HASH_FIND_STR(current->data.hash, StringValueCStr(keys[i]), kv);
-    current = kv == NULL ? NULL : kv->value;
+  for (long i = 0; i < num_parts; i++) {
+    if (current->type != i_type_hash)
+      return NULL;
+    current = snapshot_find_child(current, parts[i].key, parts[i].len);
+    if (current == NULL)
+      return NULL;
   }
-  return current;
+  return snapshot_view(store, current, view);
+}
+
+static i_object_t*
+snapshot_get(i_translations_t *store, i_key_part_t *parts, long num_parts, i_object_t *view)
+{
+  return snapshot_get_under(store, store->snapshot->nodes, parts, num_parts, view);
+}
+
+static i_translations_t*
+translation_store_get(VALUE self)
+{
+  i_translations_t *store;
+  VALUE wrapped;
+  wrapped = rb_iv_get(self, "@translations");
+  TypedData_Get_Struct(wrapped, i_translations_t, &i_translations_type, store);
+  return store;
 }
 
 /*
- *  call-seq:
- *     backend.direct_lookup([part]+)  -> localized_str
- *
- *  Returns the translation(s) found under the specified key.
- *
- *     backend.direct_lookup("en", "foo", "bar")   #=> "lol"
- *     backend.direct_lookup("en", "foo")          #=> {"bar"=>"lol", "baz"=>["asdf", "qwerty"]}
+ * For anything that changes the translations (or how they're looked up)
  */
+static i_translations_t*
+writable_store(VALUE self)
+{
+  i_translations_t *store = translation_store_get(self);
+  if (store->frozen)
+    rb_error_frozen("translations");
+  return store;
+}
 
 static VALUE
-direct_lookup(int argc, VALUE *argv, VALUE self)
+new_key_cache(unsigned long max_entries, size_t max_bytes)
 {
-  i_object_t *translations = translations_get(self);
-  return i_object_to_robject(hash_get(translations, argv, argc));
+  i_key_cache_t *cache = ALLOC(i_key_cache_t);
+  memset(cache, 0, sizeof(i_key_cache_t));
+  cache->max_entries = max_entries;
+  cache->max_bytes = max_bytes;
+  return TypedData_Wrap_Struct(rb_cObject, &i_key_cache_type, cache);
 }
 
-static void
-empty_object(i_object_t *object, int recurse)
+static i_key_cache_t*
+key_cache_get(VALUE self)
 {
-  if (object == NULL)
-    return;
+  i_key_cache_t *cache;
+  VALUE wrapped;
+  wrapped = rb_iv_get(self, "@normalized_key_cache");
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+  // frozen backends share a key cache per Ractor, see freeze_translations
+  if (NIL_P(wrapped) && !rb_ractor_local_storage_value_lookup(ractor_key_cache, &wrapped)) {
+    i_translations_t *store = translation_store_get(self);
+    wrapped = new_key_cache(store->key_cache_max_entries, store->key_cache_max_bytes);
+    rb_ractor_local_storage_value_set(ractor_key_cache, wrapped);
+  }
+#endif
+  TypedData_Get_Struct(wrapped, i_key_cache_t, &i_key_cache_type, cache);
+  return cache;
+}
 
-  switch (object->type) {
-  case i_type_array:
-    if (recurse)
-      for (unsigned long i = 0; i < object->size; i++)
-        empty_object(&object->data.array[i], 1);
-    xfree(object->data.array);
-    break;
-  case i_type_hash:
-    delete_hash(&object->data.hash, recurse);
-    break;
-  case i_type_unused:
-    break;
-  default:
-    xfree(object->data.string);
-    break;
+static i_object_t*
+hash_get(i_object_t *current, i_key_part_t *parts, long num_parts)
+{
+  i_key_value_t *kv = NULL;
+  for (long i = 0; i < num_parts && current != NULL; i++) {
+    if (current->type != i_type_hash)
+      return NULL;
+    HASH_FIND(hh, current->data.hash, parts[i].key, parts[i].len, kv);
+    current = kv == NULL ? NULL : kv->value;
+  }
+  return current;
+}
+
+static uint64_t
+path_hash_part(uint64_t hash, const char *part, unsigned long len)
+{
+  for (unsigned long i = 0; i < len; i++) {
+    hash ^= (unsigned char)part[i];
+    hash *= I_FNV_PRIME;
   }
+  hash ^= I_PATH_SEPARATOR;
+  hash *= I_FNV_PRIME;
+  return hash;
 }
 
 static void
-delete_object(i_object_t *object, int recurse)
+clear_path_index(i_path_index_t *index)
 {
-  empty_object(object, recurse);
-  if (CAN_FREE(object))
-    xfree(object);
+  if (index->paths != NULL)
+    delete_arena(index->paths);
+  xfree(index->entries);
+  index->paths = NULL;
+  index->entries = NULL;
+  index->capacity = 0;
+  index->count = 0;
 }
 
+/*
+ * Call whenever the translation tree changes; the index gets rebuilt on
+ * the next lookup
+ */
 static void
-delete_object_r(i_object_t *object)
+translations_changed(i_translations_t *store)
 {
-  delete_object(object, 1);
+  store->index.stale = 1;
+  store->links_stale = 1;
+  store->generation++;
+}
+
+static unsigned long
+count_paths(i_object_t *object)
+{
+  unsigned long count = 1;
+  if (object->type == i_type_hash)
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next)
+      count += count_paths(kv->value);
+  return count;
 }
 
 static void
-delete_key_value(i_key_value_t *kv, int delete_value)
+path_index_add(i_path_index_t *index, uint64_t hash, const char *path, unsigned long path_len, i_object_t *object)
 {
-  if (delete_value)
-    delete_object_r(kv->value);
-  xfree(kv->key);
-  xfree(kv);
+  unsigned long mask = index->capacity - 1;
+  unsigned long i = hash & mask;
+  while (index->entries[i].object != NULL)
+    i = (i + 1) & mask;
+  index->entries[i].hash = hash;
+  index->entries[i].path = arena_alloc_aligned(index->paths, path_len, 1);
+  memcpy((char *)index->entries[i].path, path, path_len);
+  index->entries[i].path_len = path_len;
+  index->entries[i].object = object;
+  index->count++;
 }
 
+/*
+ * buffer holds the current path (its parts NUL-separated), so each kv
+ * appends its key and recurses with the hash of the path so far
+ */
 static void
-delete_hash(i_key_value_t **hash, int recurse)
+build_path_index_r(i_path_index_t *index, i_object_t *hash_object, uint64_t hash, char **buffer, unsigned long *buffer_size, unsigned long path_len)
 {
-  i_key_value_t *kv, *tmp;
-  HASH_ITER(hh, *hash, kv, tmp) {
-    HASH_DEL(*hash, kv);
-    delete_key_value(kv, recurse);
+  for (i_key_value_t *kv = hash_object->data.hash; kv != NULL; kv = kv->hh.next) {
+    unsigned long key_len = strlen(kv->key),
+                  offset = path_len == 0 ? 0 : path_len + 1;
+    if (offset + key_len > *buffer_size) {
+      *buffer_size = (offset + key_len) * 2;
+      REALLOC_N(*buffer, char, *buffer_size);
+    }
+    if (offset > 0)
+      (*buffer)[path_len] = '\0';
+    memcpy(*buffer + offset, kv->key, key_len);
+
+    uint64_t kv_hash = path_hash_part(hash, kv->key, key_len);
+    path_index_add(index, kv_hash, *buffer, offset + key_len, kv->value);
+    if (kv->value->type == i_type_hash)
+      build_path_index_r(index, kv->value, kv_hash, buffer, buffer_size, offset + key_len);
   }
 }
 
 static void
-add_key_value(i_key_value_t **hash, i_key_value_t *kv)
+build_path_index(i_translations_t *store)
 {
-  i_key_value_t *existing = NULL;
-  HASH_FIND_STR(*hash, kv->key, existing);
+  i_path_index_t *index = &store->index;
+  unsigned long buffer_size = 256,
+                count = count_paths(&store->root);
+  char *buffer = ALLOC_N(char, buffer_size);
 
-  if (existing != NULL) {
-    if (existing->value->type == i_type_hash && kv->value->type == i_type_hash) {
-      merge_hash(existing->value, kv->value);
-      delete_key_value(kv, 0);
-      return;
+  clear_path_index(index);
+  index->capacity = 16;
+  while (index->capacity < count * 2)
+    index->capacity *= 2;
+  index->entries = ALLOC_N(i_path_entry_t, index->capacity);
+  memset(index->entries, 0, sizeof(i_path_entry_t) * index->capacity);
+  index->paths = new_arena(count * 16);
+  build_path_index_r(index, &store->root, I_FNV_OFFSET, &buffer, &buffer_size, 0);
+  xfree(buffer);
+  index->stale = 0;
+}
+
+static int
+path_entry_matches(i_path_entry_t *entry, i_key_part_t *parts, long num_parts)
+{
+  const char *path = entry->path,
+             *path_end = entry->path + entry->path_len;
+  for (long i = 0; i < num_parts; i++) {
+    unsigned long len = parts[i].len;
+    if (i > 0) {
+      if (path >= path_end || *path != '\0')
+        return 0;
+      path++;
     }
-    HASH_DEL(*hash, existing);
-    delete_key_value(existing, 1);
+    if ((unsigned long)(path_end - path) < len || memcmp(path, parts[i].key, len) != 0)
+      return 0;
+    path += len;
   }
-  HASH_ADD_KEYPTR(hh, *hash, kv->key, strlen(kv->key), kv);
+  return path == path_end;
 }
 
-static void
-merge_hash(i_object_t *hash, i_object_t *other_hash)
+static i_object_t*
+path_index_get(i_translations_t *store, i_key_part_t *parts, long num_parts)
 {
-  i_key_value_t *kv, *tmp;
+  i_path_index_t *index = &store->index;
+  uint64_t hash = I_FNV_OFFSET;
 
-  HASH_ITER(hh, other_hash->data.hash, kv, tmp) {
-    HASH_DEL(other_hash->data.hash, kv);
-    add_key_value(&hash->data.hash, kv);
+  if (num_parts == 0)
+    return &store->root;
+  for (long i = 0; i < num_parts; i++)
+    hash = path_hash_part(hash, parts[i].key, parts[i].len);
+  if (index->stale)
+    build_path_index(store);
+
+  unsigned long mask = index->capacity - 1;
+  for (unsigned long i = hash & mask; index->entries[i].object != NULL; i = (i + 1) & mask) {
+    i_path_entry_t *entry = &index->entries[i];
+    if (entry->hash == hash && path_entry_matches(entry, parts, num_parts))
+      return entry->object;
   }
-  delete_object_r(other_hash);
+  return NULL;
 }
 
-static int
-delete_syck_st_entry(char *key, char *value, char *arg)
+static void
+clear_key_profile(i_key_profile_t *profile)
 {
-  i_object_t *object = (i_object_t *)value;
-  // key object whose string we have yoinked into a kv, or item that
-  // has been copied into an array
-  if (object->type == i_type_unused)
-    delete_object_r(object);
-  return ST_DELETE;
+  if (profile->misses != NULL)
+    for (unsigned long i = 0; i < I_PROFILE_MAX_MISSES * 2; i++)
+      xfree(profile->misses[i].key);
+  xfree(profile->hits);
+  xfree(profile->misses);
+  profile->hits = NULL;
+  profile->misses = NULL;
+  profile->hits_capacity = 0;
+  profile->num_hits = 0;
+  profile->num_misses = 0;
+  profile->dropped_misses = 0;
+  profile->samples = 0;
+  profile->countdown = profile->rate;
 }
 
-static int
-delete_syck_object(char *key, char *value, char *arg)
+static unsigned long
+profile_hits(i_key_profile_t *profile, uint64_t hash)
 {
-  i_object_t *object = (i_object_t *)value;
-  delete_object(object, 0); // objects are in the syck symbol table, thus we don't want to double-free
-  return ST_DELETE;
+  unsigned long mask = profile->hits_capacity - 1;
+  if (profile->hits_capacity == 0)
+    return 0;
+  for (unsigned long i = hash & mask; profile->hits[i].count != 0; i = (i + 1) & mask)
+    if (profile->hits[i].hash == hash)
+      return profile->hits[i].count;
+  return 0;
 }
 
 static void
-handle_syck_error(SyckParser *parser, const char *str)
+profile_hit(i_key_profile_t *profile, uint64_t hash)
 {
-  char *endl = parser->cursor;
-  while (*endl != '\0' && *endl != '\n')
-    endl++;
-  endl[0] = '\0';
+  if (profile->num_hits * 2 >= profile->hits_capacity) {
+    i_profile_entry_t *old = profile->hits;
+    unsigned long old_capacity = profile->hits_capacity;
+    profile->hits_capacity = old_capacity == 0 ? 1024 : old_capacity * 2;
+    profile->hits = ALLOC_N(i_profile_entry_t, profile->hits_capacity);
+    memset(profile->hits, 0, sizeof(i_profile_entry_t) * profile->hits_capacity);
+    unsigned long mask = profile->hits_capacity - 1;
+    for (unsigned long i = 0; i < old_capacity; i++) {
+      if (old[i].count == 0)
+        continue;
+      unsigned long j = old[i].hash & mask;
+      while (profile->hits[j].count != 0)
+        j = (j + 1) & mask;
+      profile->hits[j] = old[i];
+    }
+    xfree(old);
+  }
 
-  if (parser->syms)
-    st_foreach(parser->syms, delete_syck_object, 0);
-  rb_raise(I18nemaBackendLoadError, "%s on line %d, col %ld: `%s'", str, parser->linect + 1, parser->cursor - parser->lineptr, parser->lineptr);
+  unsigned long mask = profile->hits_capacity - 1, i = hash & mask;
+  while (profile->hits[i].count != 0 && profile->hits[i].hash != hash)
+    i = (i + 1) & mask;
+  if (profile->hits[i].count == 0) {
+    profile->hits[i].hash = hash;
+    profile->num_hits++;
+  }
+  profile->hits[i].count++;
 }
 
-static SyckNode*
-handle_syck_badanchor(SyckParser *parser, char *anchor)
+static void
+profile_miss(i_key_profile_t *profile, uint64_t hash, i_key_part_t *parts, long num_parts)
 {
-  char error[strlen(anchor) + 14];
-  sprintf(error, "bad anchor `%s'", anchor);
-  handle_syck_error(parser, error);
-  return NULL;
+  unsigned long mask = I_PROFILE_MAX_MISSES * 2 - 1, i = hash & mask;
+  if (profile->misses == NULL) {
+    profile->misses = ALLOC_N(i_profile_entry_t, I_PROFILE_MAX_MISSES * 2);
+    memset(profile->misses, 0, sizeof(i_profile_entry_t) * I_PROFILE_MAX_MISSES * 2);
+  }
+  while (profile->misses[i].count != 0 && profile->misses[i].hash != hash)
+    i = (i + 1) & mask;
+  if (profile->misses[i].count != 0) {
+    profile->misses[i].count++;
+    return;
+  }
+  if (profile->num_misses == I_PROFILE_MAX_MISSES) {
+    profile->dropped_misses++;
+    return;
+  }
+
+  i_profile_entry_t *entry = &profile->misses[i];
+  unsigned long len = 0;
+  profile->num_misses++;
+  for (long j = 0; j < num_parts; j++)
+    len += parts[j].len + 1;
+  entry->hash = hash;
+  entry->count = 1;
+  entry->key = ALLOC_N(char, len + 1);
+  len = 0;
+  for (long j = 0; j < num_parts; j++) {
+    if (j > 0)
+      entry->key[len++] = '.';
+    memcpy(entry->key + len, parts[j].key, parts[j].len);
+    len += parts[j].len;
+  }
+  entry->key[len] = '\0';
 }
 
-static char*
-new_string(char *orig, long len)
+/*
+ * Whether this lookup gets sampled for key_profile (never once frozen,
+ * since Ractors may be looking things up in parallel)
+ */
+static inline int
+profile_sample_p(i_translations_t *store)
 {
-  char *str = xmalloc(len + 1);
-  strncpy(str, orig, len);
-  str[len] = '\0';
-  return str;
+  i_key_profile_t *profile = &store->profile;
+  if (profile->rate == 0 || store->frozen || --profile->countdown > 0)
+    return 0;
+  profile->countdown = profile->rate;
+  return 1;
 }
 
 static void
-set_string_object(i_object_t *object, char *str, long len)
+profile_lookup(i_translations_t *store, i_key_part_t *parts, long num_parts, i_object_t *result)
 {
-  object->type = i_type_string;
-  object->size = len;
-  object->data.string = new_string(str, len);
+  uint64_t hash = I_FNV_OFFSET;
+  for (long i = 0; i < num_parts; i++)
+    hash = path_hash_part(hash, parts[i].key, parts[i].len);
+  store->profile.samples++;
+  if (result != NULL && result->type != i_type_null)
+    profile_hit(&store->profile, hash);
+  else
+    profile_miss(&store->profile, hash, parts, num_parts);
 }
 
-static i_object_t*
-new_string_object(char *str, long len)
+static i_object_t**
+symbol_link(i_object_t *symbol)
 {
-  i_object_t *object = ALLOC(i_object_t);
-  set_string_object(object, str, len);
-  return object;
+  return (i_object_t **)(symbol->data.string - sizeof(i_object_t *));
 }
 
+/*
+ * Like hash_get, but with the parts in a single dot-separated key (empty
+ * parts are skipped, like normalize_keys does)
+ */
 static i_object_t*
-new_array_object(long size)
+hash_get_dotted(i_object_t *current, const char *key)
 {
-  i_object_t *object = ALLOC(i_object_t);
-  object->type = i_type_array;
-  object->size = size;
-  object->data.array = ALLOC_N(i_object_t, size);
-  return object;
+  i_key_value_t *kv = NULL;
+  while (current != NULL && *key) {
+    size_t len = strcspn(key, ".");
+    if (len > 0) {
+      if (current->type != i_type_hash)
+        return NULL;
+      HASH_FIND(hh, current->data.hash, key, len, kv);
+      current = kv == NULL ? NULL : kv->value;
+    }
+    key += len;
+    if (*key)
+      key++;
+  }
+  return current;
 }
 
-static i_object_t*
-new_hash_object()
+static void
+reset_symbol_links(i_object_t *hash_object)
 {
-  i_object_t *object = ALLOC(i_object_t);
-  object->type = i_type_hash;
-  object->data.hash = NULL;
-  return object;
+  for (i_key_value_t *kv = hash_object->data.hash; kv != NULL; kv = kv->hh.next) {
+    if (kv->value->type == i_type_symbol)
+      *symbol_link(kv->value) = &i_link_unresolved;
+    else if (kv->value->type == i_type_hash)
+      reset_symbol_links(kv->value);
+  }
 }
 
-static i_key_value_t*
-new_key_value(char *key, i_object_t *value)
+/*
+ * Finds what symbol points to under locale, following chains of them.
+ * NULL if it points nowhere (or to nil), or if it's part of a cycle
+ */
+static i_object_t*
+resolve_symbol_link(i_object_t *locale, i_object_t *symbol, int depth)
 {
-  i_key_value_t *kv = ALLOC(i_key_value_t);
-  kv->key = key;
-  kv->value = value;
-  return kv;
+  i_object_t **link = symbol_link(symbol), *target;
+  if (*link == &i_link_pending)
+    return NULL;
+  if (*link != &i_link_unresolved)
+    return *link;
+
+  *link = &i_link_pending;
+  target = hash_get_dotted(locale, symbol->data.string);
+  if (target != NULL && target->type == i_type_symbol)
+    target = depth < I_LINK_MAX_DEPTH ? resolve_symbol_link(locale, target, depth + 1) : NULL;
+  if (target != NULL && target->type == i_type_null)
+    target = NULL;
+  *link = target;
+  return target;
 }
 
-static SYMID
-handle_syck_node(SyckParser *parser, SyckNode *node)
+static void
+resolve_symbol_links_r(i_object_t *locale, i_object_t *hash_object)
 {
-  i_object_t *result;
-  SYMID oid;
-
-  switch (node->kind) {
-  case syck_str_kind:
-    if (node->type_id == NULL) {
-      result = new_string_object(node->data.str->ptr, node->data.str->len);
-    } else if (strcmp(node->type_id, "null") == 0) {
-      result = &i_object_null;
-    } else if (strcmp(node->type_id, "bool#yes") == 0) {
-      result = &i_object_true;
-    } else if (strcmp(node->type_id, "bool#no") == 0) {
-      result = &i_object_false;
-    } else if (strcmp(node->type_id, "int") == 0) {
-      syck_str_blow_away_commas(node);
-      result = new_string_object(node->data.str->ptr, node->data.str->len);
-      result->type = i_type_int;
-    } else if (strcmp(node->type_id, "float#fix") == 0 || strcmp(node->type_id, "float#exp") == 0) {
-      syck_str_blow_away_commas(node);
-      result = new_string_object(node->data.str->ptr, node->data.str->len);
-      result->type = i_type_float;
-    } else if (node->data.str->style == scalar_plain && node->data.str->len > 1 && strncmp(node->data.str->ptr, ":", 1) == 0) {
-      result = new_string_object(node->data.str->ptr + 1, node->data.str->len - 1);
-      result->type = i_type_symbol;
-    } else {
-      // legit strings, and everything else get the string treatment (binary, int#hex, timestamp, etc.)
-      result = new_string_object(node->data.str->ptr, node->data.str->len);
-    }
-    break;
-  case syck_seq_kind:
-    result = new_array_object(node->data.list->idx);
-    for (long i = 0; i < node->data.list->idx; i++) {
-      i_object_t *item = NULL;
-
-      oid = syck_seq_read(node, i);
-      syck_lookup_sym(parser, oid, (void **)&item);
-      if (item->type == i_type_string)
-        current_translation_count++;
-      memcpy(&result->data.array[i], item, sizeof(i_object_t));
-      if (CAN_FREE(item))
-        item->type = i_type_unused;
-    }
-    break;
-  case syck_map_kind:
-    result = new_hash_object();
-    for (long i = 0; i < node->data.pairs->idx; i++) {
-      i_object_t *key = NULL, *value = NULL;
-
-      oid = syck_map_read(node, map_key, i);
-      syck_lookup_sym(parser, oid, (void **)&key);
-      oid = syck_map_read(node, map_value, i);
-      syck_lookup_sym(parser, oid, (void **)&value);
-
-      i_key_value_t *kv = new_key_value(key->data.string, value);
-      key->type = i_type_unused; // so we know to free this node in delete_syck_st_entry
-      if (value->type == i_type_string)
-        current_translation_count++;
-      add_key_value(&result->data.hash, kv);
-    }
-    break;
+  for (i_key_value_t *kv = hash_object->data.hash; kv != NULL; kv = kv->hh.next) {
+    if (kv->value->type == i_type_symbol)
+      resolve_symbol_link(locale, kv->value, 0);
+    else if (kv->value->type == i_type_hash)
+      resolve_symbol_links_r(locale, kv->value);
   }
-
-
-  return syck_add_sym(parser, (char *)result);
 }
 
 /*
- *  call-seq:
- *     backend.load_yaml_string(yaml_str) -> num_translations
- *
- *  Loads translations from the specified yaml string, and returns the
- *  number of (new) translations stored.
- *
- *     backend.load_yaml_string("en:\n  foo: bar")   #=> 1
+ * Points each symbol value at the node it links to within its locale,
+ * the way I18n would resolve it for an unscoped lookup
  */
-
-static VALUE
-load_yml_string(VALUE self, VALUE yml)
+static void
+resolve_symbol_links(i_translations_t *store)
 {
-  SYMID oid;
-  i_object_t *root_object = translations_get(self);
-  i_object_t *new_root_object = NULL;
-  current_translation_count = 0;
-  SyckParser* parser = syck_new_parser();
-  syck_parser_handler(parser, handle_syck_node);
-  StringValue(yml);
-  syck_parser_str(parser, RSTRING_PTR(yml), RSTRING_LEN(yml), NULL);
-  syck_parser_bad_anchor_handler(parser, handle_syck_badanchor);
-  syck_parser_error_handler(parser, handle_syck_error);
-
-  oid = syck_parse(parser);
-  syck_lookup_sym(parser, oid, (void **)&new_root_object);
-  if (parser->syms)
-    st_foreach(parser->syms, delete_syck_st_entry, 0);
-  syck_free_parser(parser);
-  if (new_root_object == NULL || new_root_object->type != i_type_hash) {
-    delete_object_r(new_root_object);
-    rb_raise(I18nemaBackendLoadError, "root yml node is not a hash");
+  for (i_key_value_t *kv = store->root.data.hash; kv != NULL; kv = kv->hh.next) {
+    if (kv->value->type == i_type_hash)
+      reset_symbol_links(kv->value);
   }
-  merge_hash(root_object, new_root_object);
-
-  return INT2NUM(current_translation_count);
+  for (i_key_value_t *kv = store->root.data.hash; kv != NULL; kv = kv->hh.next) {
+    if (kv->value->type == i_type_hash)
+      resolve_symbol_links_r(kv->value, kv->value);
+  }
+  store->links_stale = 0;
 }
 
 /*
- *  call-seq:
- *     backend.available_locales -> locales
- *
- *  Returns the currently loaded locales. Order is not guaranteed.
- *
- *     backend.available_locales   #=> [:en, :es]
+ * With resolve_links, the node symbol links to (if any)
  */
-
-static VALUE
-available_locales(VALUE self)
+static i_object_t*
+follow_symbol_link(i_translations_t *store, i_object_t *symbol)
 {
-  if (!RTEST(rb_iv_get(self, "@initialized")))
-    rb_funcall(self, s_init_translations, 0);
-  i_object_t *root_object = translations_get(self);
-  i_key_value_t *current = root_object->data.hash;
-  VALUE ary = rb_ary_new2(0);
-
-  for (; current != NULL; current = current->hh.next)
-    rb_ary_push(ary, rb_str_intern(rb_str_new2(current->key)));
-
-  return ary;
+  if (!store->resolve_links || store->snapshot != NULL)
+    return symbol;
+  if (store->links_stale)
+    resolve_symbol_links(store);
+  i_object_t *target = *symbol_link(symbol);
+  return target == NULL ? symbol : target;
 }
 
 /*
- *  call-seq:
- *     backend.reload! -> true
- *
- *  Clears out all currently stored translations.
- *
- *     backend.reload!   #=> true
+ * With lazy_locales, has locale's files loaded (see load_locale) the
+ * first time it's needed, and inflates it if it's been compressed. locale
+ * is a String, or nil for all of them.
  */
-
-static VALUE
-reload(VALUE self)
+static void
+ensure_locale(VALUE self, i_translations_t *store, VALUE locale)
 {
-  i_object_t *root_object = translations_get(self);
-  empty_object(root_object, 1);
-  rb_iv_set(self, "@initialized", Qfalse);
-  return Qtrue;
+  VALUE pending = rb_ivar_get(self, s_pending_locales);
+  if (!NIL_P(pending) && RHASH_SIZE(pending) > 0 &&
+      (NIL_P(locale) || rb_hash_lookup2(pending, locale, Qundef) != Qundef))
+    rb_funcall(self, s_load_locale, 1, locale);
+  if (store->cold_locales != NULL)
+    touch_cold_locale(store, locale);
 }
 
-static VALUE
-join_array_key(VALUE self, VALUE key, VALUE separator)
+/*
+ * view is scratch space in case the result comes from a snapshot
+ */
+static i_object_t*
+translations_lookup(i_translations_t *store, i_key_part_t *parts, long num_parts, i_object_t *view)
 {
-  long len = RARRAY_LEN(key);
-  if (len == 0)
-    return rb_str_new("", 0);
+  if (store->snapshot != NULL)
+    return snapshot_get(store, parts, num_parts, view);
+  if (store->index.enabled)
+    return path_index_get(store, parts, num_parts);
+  return hash_get(&store->root, parts, num_parts);
+}
 
-  VALUE ret = rb_ary_join(normalize_key(self, RARRAY_PTR(key)[0], separator), separator);
-  for (long i = 1; i < len; i++) {
-    rb_str_concat(ret, separator);
-    rb_str_concat(ret, rb_ary_join(normalize_key(self, RARRAY_PTR(key)[i], separator), separator));
-  }
-  return ret;
+/*
+ * Same as translations_lookup, but with prefix being what the first
+ * prefix_len parts already resolved to, so that keys sharing a scope
+ * only walk it once
+ */
+static i_object_t*
+translations_lookup_under(i_translations_t *store, i_object_t *prefix, i_key_part_t *parts, long prefix_len, long num_parts, i_object_t *view)
+{
+  if (prefix == NULL)
+    return NULL;
+  if (num_parts == prefix_len)
+    return prefix;
+  if (store->snapshot != NULL)
+    return prefix->type == i_type_snapshot_hash ?
+      snapshot_get_under(store, prefix->data.snapshot, parts + prefix_len, num_parts - prefix_len, view) : NULL;
+  if (store->index.enabled)
+    return path_index_get(store, parts, num_parts); // one probe either way
+  return hash_get(prefix, parts + prefix_len, num_parts - prefix_len);
 }
 
 /*
  *  call-seq:
- *     backend.normalize_key(key, separator) -> key
+ *     backend.direct_lookup([part]+)  -> localized_str
  *
- *  Normalizes and splits a key based on the separator.
+ *  Returns the translation(s) found under the specified key.
  *
- *     backend.normalize_key "asdf", "."    #=> ["asdf"]
- *     backend.normalize_key "a.b.c", "."   #=> ["a", "b", "c"]
- *     backend.normalize_key "a.b.c", ":"   #=> ["a.b.c"]
- *     backend.normalize_key %{a b.c}, "."  #=> ["a", "b", "c"]
+ *     backend.direct_lookup("en", "foo", "bar")   #=> "lol"
+ *     backend.direct_lookup("en", "foo")          #=> {"bar"=>"lol", "baz"=>["asdf", "qwerty"]}
  */
 
 static VALUE
-normalize_key(VALUE self, VALUE key, VALUE separator)
+direct_lookup(int argc, VALUE *argv, VALUE self)
 {
-  Check_Type(separator, T_STRING);
+  i_translations_t *store = translation_store_get(self);
+  VALUE parts_tmp = 0;
+  i_key_part_t *parts = ALLOCV_N(i_key_part_t, parts_tmp, argc);
+  i_object_t view;
+  for (int i = 0; i < argc; i++) {
+    Check_Type(argv[i], T_STRING);
+    parts[i].key = StringValueCStr(argv[i]);
+    parts[i].len = RSTRING_LEN(argv[i]);
+  }
+  ensure_locale(self, store, argc > 0 ? argv[0] : Qnil);
+  i_object_t *result = translations_lookup(store, parts, argc, &view);
+  if (argc > 0 && profile_sample_p(store))
+    profile_lookup(store, parts, argc, result);
+  ALLOCV_END(parts_tmp);
+  return i_object_to_robject(result, store);
+}
+
+/*
+ * Builds JSON straight from the tree, either into a single string (sized
+ * by a first, measuring pass) or in chunks written to an IO
+ */
+typedef struct i_json_writer
+{
+  i_translations_t *store;
+  VALUE io;
+  VALUE buffer;
+  char *ptr;
+  long len;
+  long capacity;
+  long written; // to io so far
+  int measure;
+  unsigned long generation; // of the store, when we started
+} i_json_writer_t;
+
+/*
+ * Other threads can run whenever we call into ruby (e.g. io.write), and
+ * we can't go on walking a tree they've changed (or freed)
+ */
+static void
+json_check_generation(i_json_writer_t *writer)
+{
+  if (writer->store->generation != writer->generation)
+    rb_raise(rb_eRuntimeError, "translations changed while exporting");
+}
+
+static void
+json_new_buffer(i_json_writer_t *writer)
+{
+  writer->buffer = rb_enc_associate(rb_str_buf_new(writer->capacity), rb_utf8_encoding());
+  writer->ptr = RSTRING_PTR(writer->buffer);
+  writer->len = 0;
+}
+
+static void
+json_flush(i_json_writer_t *writer)
+{
+  rb_str_set_len(writer->buffer, writer->len);
+  rb_io_write(writer->io, writer->buffer);
+  writer->written += writer->len;
+  json_new_buffer(writer); // rather than reusing it, in case io holds on to it
+  json_check_generation(writer);
+}
+
+static void
+json_write(i_json_writer_t *writer, const char *data, long len)
+{
+  if (writer->measure) {
+    writer->len += len;
+    return;
+  }
+  if (writer->len + len > writer->capacity) {
+    if (NIL_P(writer->io)) {
+      while (writer->len + len > writer->capacity)
+        writer->capacity *= 2;
+      rb_str_resize(writer->buffer, writer->capacity);
+      writer->ptr = RSTRING_PTR(writer->buffer);
+    } else {
+      json_flush(writer);
+      if (len > writer->capacity) {
+        rb_io_write(writer->io, rb_enc_str_new(data, len, rb_utf8_encoding()));
+        writer->written += len;
+        json_check_generation(writer);
+        return;
+      }
+    }
+  }
+  memcpy(writer->ptr + writer->len, data, len);
+  writer->len += len;
+}
+
+/*
+ * Escaped the same way JSON.generate does it
+ */
+static void
+json_string(i_json_writer_t *writer, const char *str, unsigned long len)
+{
+  static const char hex[] = "0123456789abcdef";
+  const char *end = str + len, *run = str;
+  char escape[6] = {'\\', 'u', '0', '0', 0, 0};
+
+  json_write(writer, "\"", 1);
+  for (const char *p = str; p < end; p++) {
+    unsigned char c = *p;
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    json_write(writer, run, p - run);
+    run = p + 1;
+    switch (c) {
+    case '"': json_write(writer, "\\\"", 2); break;
+    case '\\': json_write(writer, "\\\\", 2); break;
+    case '\n': json_write(writer, "\\n", 2); break;
+    case '\r': json_write(writer, "\\r", 2); break;
+    case '\t': json_write(writer, "\\t", 2); break;
+    case '\f': json_write(writer, "\\f", 2); break;
+    case '\b': json_write(writer, "\\b", 2); break;
+    default:
+      escape[4] = hex[c >> 4];
+      escape[5] = hex[c & 0xf];
+      json_write(writer, escape, 6);
+    }
+  }
+  json_write(writer, run, end - run);
+  json_write(writer, "\"", 1);
+}
+
+static void json_object(i_json_writer_t *writer, i_object_t *object);
+
+static void
+json_key_value(i_json_writer_t *writer, const char *key, unsigned long len, i_object_t *value, int first)
+{
+  if (!first)
+    json_write(writer, ",", 1);
+  json_string(writer, key, len);
+  json_write(writer, ":", 1);
+  json_object(writer, value);
+}
+
+static void
+json_object(i_json_writer_t *writer, i_object_t *object)
+{
+  i_translations_t *store = writer->store;
+  i_object_t view;
+  const char *str;
+  VALUE rstr;
+
+  switch (object->type) {
+  case i_type_string:
+  case i_type_symbol:
+    json_string(writer, object->data.string, object->size);
+    break;
+  case i_type_int:
+    str = object->data.string;
+    if (*str == '+')
+      str++;
+    json_write(writer, str, strlen(str));
+    break;
+  case i_type_float:
+    // formatted like Float#to_json
+    rstr = i_object_to_robject(object, store);
+    if (!isfinite(NUM2DBL(rstr)))
+      rb_raise(rb_eRangeError, "%s is not valid JSON", object->data.string);
+    rstr = rb_funcall(rstr, s_to_s, 0);
+    json_check_generation(writer);
+    json_write(writer, RSTRING_PTR(rstr), RSTRING_LEN(rstr));
+    break;
+  case i_type_true:
+    json_write(writer, "true", 4);
+    break;
+  case i_type_false:
+    json_write(writer, "false", 5);
+    break;
+  case i_type_array:
+    json_write(writer, "[", 1);
+    for (unsigned long i = 0; i < object->size; i++) {
+      if (i > 0)
+        json_write(writer, ",", 1);
+      json_object(writer, &object->data.array[i]);
+    }
+    json_write(writer, "]", 1);
+    break;
+  case i_type_hash:
+    json_write(writer, "{", 1);
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next)
+      json_key_value(writer, kv->key, kv->hh.keylen, kv->value, kv == object->data.hash);
+    json_write(writer, "}", 1);
+    break;
+  case i_type_snapshot_array: {
+    const i_snapshot_node_t *items = (i_snapshot_node_t *)SNAPSHOT_AT(object->data.snapshot, object->data.snapshot->offset);
+    json_write(writer, "[", 1);
+    for (unsigned long i = 0; i < object->size; i++) {
+      if (i > 0)
+        json_write(writer, ",", 1);
+      json_object(writer, snapshot_view(store, &items[i], &view));
+    }
+    json_write(writer, "]", 1);
+    break;
+  }
+  case i_type_snapshot_hash: {
+    const i_snapshot_child_t *children = (i_snapshot_child_t *)SNAPSHOT_AT(object->data.snapshot, object->data.snapshot->offset);
+    json_write(writer, "{", 1);
+    for (unsigned long i = 0; i < object->size; i++) {
+      const i_snapshot_child_t *child = &children[i];
+      const i_snapshot_node_t *node = (i_snapshot_node_t *)SNAPSHOT_AT(child, child->node);
+      json_key_value(writer, SNAPSHOT_AT(child, child->key), child->key_size, snapshot_view(store, node, &view), i == 0);
+    }
+    json_write(writer, "}", 1);
+    break;
+  }
+  default:
+    json_write(writer, "null", 4);
+  }
+}
+
+/*
+ * Like json_object, but with just the given keys (in that order) if
+ * object is a hash
+ */
+static void
+json_export(i_json_writer_t *writer, i_object_t *object, VALUE only)
+{
+  i_object_t view;
+  int first = 1;
+
+  if (NIL_P(only) || (object->type != i_type_hash && object->type != i_type_snapshot_hash)) {
+    json_object(writer, object);
+    return;
+  }
+  json_write(writer, "{", 1);
+  for (long i = 0; i < RARRAY_LEN(only); i++) {
+    VALUE key = RARRAY_PTR(only)[i];
+    i_key_part_t part = {RSTRING_PTR(key), RSTRING_LEN(key)};
+    i_object_t *value;
+    if (object->type == i_type_hash) {
+      value = hash_get(object, &part, 1);
+    } else {
+      const i_snapshot_node_t *node = snapshot_find_child(object->data.snapshot, part.key, part.len);
+      value = node == NULL ? NULL : snapshot_view(writer->store, node, &view);
+    }
+    if (value == NULL)
+      continue;
+    json_key_value(writer, part.key, part.len, value, first);
+    first = 0;
+  }
+  json_write(writer, "}", 1);
+}
+
+/*
+ *  call-seq:
+ *     backend.dump_json(parts, only, io) -> json_str, num_bytes or nil
+ *
+ *  Serializes the translation(s) found under parts as JSON, optionally
+ *  with just the keys in only. If io is nil, returns a string; otherwise
+ *  writes to io as it goes and returns the number of bytes written.
+ *  Returns nil if there's nothing there.
+ */
+
+static VALUE
+dump_json(VALUE self, VALUE parts, VALUE only, VALUE io)
+{
+  i_translations_t *store = translation_store_get(self);
+  i_json_writer_t writer = {store, io, Qnil, NULL, 0, 0, 0, 0, 0};
+  i_key_part_t *key_parts;
+  i_object_t view, *object;
+  long num_parts;
+  VALUE key_parts_tmp = 0;
+
+  Check_Type(parts, T_ARRAY);
+  num_parts = RARRAY_LEN(parts);
+  key_parts = ALLOCV_N(i_key_part_t, key_parts_tmp, num_parts);
+  for (long i = 0; i < num_parts; i++) {
+    VALUE part = RARRAY_PTR(parts)[i];
+    Check_Type(part, T_STRING);
+    key_parts[i].key = StringValueCStr(part);
+    key_parts[i].len = RSTRING_LEN(part);
+  }
+  if (!NIL_P(only)) {
+    Check_Type(only, T_ARRAY);
+    for (long i = 0; i < RARRAY_LEN(only); i++)
+      Check_Type(RARRAY_PTR(only)[i], T_STRING);
+  }
+  ensure_locale(self, store, num_parts > 0 ? RARRAY_PTR(parts)[0] : Qnil);
+  writer.generation = store->generation;
+
+  object = translations_lookup(store, key_parts, num_parts, &view);
+  ALLOCV_END(key_parts_tmp);
+  if (object == NULL)
+    return Qnil;
+
+  if (NIL_P(io)) {
+    writer.measure = 1;
+    json_export(&writer, object, only);
+    writer.measure = 0;
+    writer.capacity = writer.len > 0 ? writer.len : 1;
+  } else {
+    writer.capacity = I_JSON_CHUNK_SIZE;
+  }
+  json_new_buffer(&writer);
+  json_export(&writer, object, only);
+  rb_str_set_len(writer.buffer, writer.len);
+  if (NIL_P(io))
+    return writer.buffer;
+
+  if (writer.len > 0) {
+    rb_io_write(io, writer.buffer);
+    writer.written += writer.len;
+  }
+  RB_GC_GUARD(writer.buffer);
+  return LONG2NUM(writer.written);
+}
+
+/*
+ *  call-seq:
+ *     backend.path_index = enabled -> enabled
+ *
+ *  Enables or disables the full-path index. When enabled, lookups hash
+ *  the whole key once and do a single probe into a flat table, rather
+ *  than walking the tree one key part at a time. The index costs some
+ *  extra memory, and is rebuilt lazily after translations change. It is
+ *  not used while translations come from a snapshot.
+ *
+ *     backend.path_index = true
+ */
+
+static VALUE
+set_path_index(VALUE self, VALUE enabled)
+{
+  i_translations_t *store = writable_store(self);
+  store->index.enabled = RTEST(enabled);
+  store->index.stale = 1;
+  if (!store->index.enabled)
+    clear_path_index(&store->index);
+  return enabled;
+}
+
+/*
+ *  call-seq:
+ *     backend.path_index? -> bool
+ *
+ *  Whether lookups go through the full-path index.
+ */
+
+static VALUE
+path_index_p(VALUE self)
+{
+  return translation_store_get(self)->index.enabled ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *     backend.resolve_links = enabled -> enabled
+ *
+ *  When enabled, symbol values (links to other keys in the same locale)
+ *  are resolved to the nodes they point to, following chains of them,
+ *  so that an unscoped lookup of a linked key returns the target
+ *  directly rather than a Symbol for I18n to translate all over again.
+ *  Links that point nowhere, or are part of a cycle, are left to I18n.
+ *  They are re-resolved lazily after translations change, and are not
+ *  used while translations come from a snapshot.
+ *
+ *     backend.resolve_links = true
+ */
+
+static VALUE
+set_resolve_links(VALUE self, VALUE enabled)
+{
+  i_translations_t *store = writable_store(self);
+  store->resolve_links = RTEST(enabled);
+  store->links_stale = 1;
+  return enabled;
+}
+
+/*
+ *  call-seq:
+ *     backend.resolve_links? -> bool
+ *
+ *  Whether lookups follow symbol links.
+ */
+
+static VALUE
+resolve_links_p(VALUE self)
+{
+  return translation_store_get(self)->resolve_links ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *     backend.freeze_translations -> backend
+ *
+ *  Makes the translations immutable, so that lookups can run in parallel
+ *  from any number of Ractors (see freeze!). Anything that would have
+ *  happened lazily on lookup (the path index, symbol links, interning
+ *  placeholder names) happens now, plural rule callables are made
+ *  shareable, and anything that would change the translations raises
+ *  FrozenError from here on.
+ *
+ *  The normalized key cache moves into the current Ractor, and every
+ *  other Ractor gets its own (with the same limits) the first time it
+ *  needs one.
+ */
+
+static VALUE
+freeze_translations(VALUE self)
+{
+  i_translations_t *store = writable_store(self);
+  i_key_cache_t *cache = key_cache_get(self);
+  i_string_cache_t *string_cache = &store->string_cache;
+
+  // lookups can't inflate anything from here on
+  warm_cold_locales(store);
+  clear_cold_locales(store);
+  store->idle_round = 0;
+  if (store->snapshot == NULL) {
+    if (store->index.enabled && store->index.stale)
+      build_path_index(store);
+    if (store->resolve_links && store->links_stale)
+      resolve_symbol_links(store);
+    intern_template_names(&store->root);
+  } else if (string_cache->enabled && string_cache->snapshot_slots == NULL) {
+    const i_snapshot_header_t *header = (i_snapshot_header_t *)store->snapshot->data;
+    string_cache->snapshot_slots = ALLOC_N(unsigned int, header->node_count);
+    memset(string_cache->snapshot_slots, 0, sizeof(unsigned int) * header->node_count);
+  }
+#ifdef HAVE_RB_RACTOR_MAKE_SHAREABLE
+  for (i_plural_rule_t *rule = store->plural_rules; rule != NULL; rule = rule->hh.next)
+    if (!NIL_P(rule->callable))
+      rb_ractor_make_shareable(rule->callable);
+#endif
+  load_reserved_keys();
+  store->key_cache_max_entries = cache->max_entries;
+  store->key_cache_max_bytes = cache->max_bytes;
+  store->frozen = 1;
+
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+  VALUE key_cache = rb_iv_get(self, "@normalized_key_cache"), existing;
+  if (!rb_ractor_local_storage_value_lookup(ractor_key_cache, &existing))
+    rb_ractor_local_storage_value_set(ractor_key_cache, key_cache);
+  rb_iv_set(self, "@normalized_key_cache", Qnil);
+#endif
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     backend.frozen_strings = enabled -> enabled
+ *
+ *  When enabled, string translations are returned as frozen,
+ *  deduplicated strings that are created on first lookup and reused
+ *  thereafter, rather than allocating a new string on every lookup.
+ *  Callers must not mutate what they get back.
+ *
+ *     backend.frozen_strings = true
+ *     backend.direct_lookup("en", "foo", "bar").frozen?   #=> true
+ */
+
+static VALUE
+set_frozen_strings(VALUE self, VALUE enabled)
+{
+  i_string_cache_t *cache = &writable_store(self)->string_cache;
+  cache->enabled = RTEST(enabled);
+  if (!cache->enabled)
+    clear_string_cache(cache, 1);
+  return enabled;
+}
+
+/*
+ *  call-seq:
+ *     backend.frozen_strings? -> bool
+ *
+ *  Whether string translations are cached as frozen strings.
+ */
+
+static VALUE
+frozen_strings_p(VALUE self)
+{
+  return translation_store_get(self)->string_cache.enabled ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *     backend.string_pool = enabled -> enabled
+ *
+ *  When enabled, subsequent loads intern keys and string values into a
+ *  pool shared by the whole backend, so that a string occurring in many
+ *  places (or locales) is stored (and its template compiled) just once.
+ *  Pooled strings are kept until reload!, even if reload_changed! or
+ *  store_translations stops using them. See stats for how much it saves,
+ *  and how much is orphaned that way.
+ *
+ *     backend.string_pool = true
+ */
+
+static VALUE
+set_string_pool(VALUE self, VALUE enabled)
+{
+  writable_store(self)->pool.enabled = RTEST(enabled);
+  return enabled;
+}
+
+/*
+ *  call-seq:
+ *     backend.string_pool? -> bool
+ *
+ *  Whether loads intern strings into the string pool.
+ */
+
+static VALUE
+string_pool_p(VALUE self)
+{
+  return translation_store_get(self)->pool.enabled ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *     backend.keep_sources = enabled -> enabled
+ *
+ *  When enabled, subsequent store_translations and load_yml_string calls
+ *  keep a copy of what they load, so that reload_changed! can merge it in
+ *  again when a file sharing its subtrees changes. Otherwise (the default, since that copy
+ *  is as big as the translations themselves) such a change makes
+ *  reload_changed! fall back to reload!. Meant for development.
+ *
+ *     backend.keep_sources = true
+ */
+
+static VALUE
+set_keep_sources(VALUE self, VALUE enabled)
+{
+  writable_store(self)->keep_sources = RTEST(enabled);
+  return enabled;
+}
+
+/*
+ *  call-seq:
+ *     backend.keep_sources? -> bool
+ *
+ *  Whether loads keep a copy of their translations for reload_changed!.
+ */
+
+static VALUE
+keep_sources_p(VALUE self)
+{
+  return translation_store_get(self)->keep_sources ? Qtrue : Qfalse;
+}
+
+static void
+empty_object(i_object_t *object, int recurse)
+{
+  if (object == NULL)
+    return;
+
+  switch (object->type) {
+  case i_type_array:
+    if (recurse)
+      for (unsigned long i = 0; i < object->size; i++)
+        empty_object(&object->data.array[i], 1);
+    xfree(object->data.array);
+    break;
+  case i_type_hash:
+    delete_hash(&object->data.hash, recurse);
+    break;
+  case i_type_unused:
+    break;
+  default:
+    xfree(object->data.string);
+    break;
+  }
+}
+
+static void
+delete_object(i_object_t *object, int recurse)
+{
+  empty_object(object, recurse);
+  if (CAN_FREE(object))
+    xfree(object);
+}
+
+static void
+delete_object_r(i_object_t *object)
+{
+  delete_object(object, 1);
+}
+
+static void
+delete_key_value(i_key_value_t *kv, int delete_value)
+{
+  if (delete_value)
+    delete_object_r(kv->value);
+  xfree(kv->key);
+  xfree(kv);
+}
+
+static void
+delete_hash(i_key_value_t **hash, int recurse)
+{
+  i_key_value_t *kv, *tmp;
+  HASH_ITER(hh, *hash, kv, tmp) {
+    HASH_DEL(*hash, kv);
+    delete_key_value(kv, recurse);
+  }
+}
+
+/*
+ * Translation trees are arena-allocated, so anything that gets replaced
+ * or merged away is simply unlinked; it's reclaimed along with its arena
+ */
+static void
+add_key_value(i_key_value_t **hash, i_key_value_t *kv)
+{
+  i_key_value_t *existing = NULL;
+  HASH_FIND_STR(*hash, kv->key, existing);
+
+  if (existing != NULL) {
+    if (existing->value->type == i_type_hash && kv->value->type == i_type_hash) {
+      merge_hash(existing->value, kv->value);
+      return;
+    }
+    HASH_DEL(*hash, existing);
+    if (merge_string_cache != NULL)
+      release_cached_rstrings(merge_string_cache, existing->value);
+  }
+  HASH_ADD_KEYPTR(hh, *hash, kv->key, strlen(kv->key), kv);
+}
+
+static void
+merge_hash(i_object_t *hash, i_object_t *other_hash)
+{
+  i_key_value_t *kv, *tmp;
+
+  HASH_ITER(hh, other_hash->data.hash, kv, tmp) {
+    HASH_DEL(other_hash->data.hash, kv);
+    add_key_value(&hash->data.hash, kv);
+  }
+}
+
+static void
+handle_syck_error(SyckParser *parser, const char *str)
+{
+  i_parse_t *parse = (i_parse_t *)parser->bonus;
+  parse->failed = 1;
+  if (!parse->raise)
+    return;
+  if (parser->cursor == NULL) // e.g. from a node handler, after the lexer is done
+    rb_raise(I18nemaBackendLoadError, "%s", str);
+
+  char *endl = parser->cursor;
+  while (*endl != '\0' && *endl != '\n')
+    endl++;
+  endl[0] = '\0';
+
+  // parse_yml cleans up after us
+  rb_raise(I18nemaBackendLoadError, "%s on line %d, col %ld: `%s'", str, parser->linect + 1, parser->cursor - parser->lineptr, parser->lineptr);
+}
+
+static SyckNode*
+handle_syck_badanchor(SyckParser *parser, char *anchor)
+{
+  char error[strlen(anchor) + 14];
+  sprintf(error, "bad anchor `%s'", anchor);
+  handle_syck_error(parser, error);
+  return syck_new_str2("", 0, scalar_none); // the parse is toast anyway
+}
+
+/*
+ * Constructors take the arena to allocate from; a NULL arena means a
+ * regular heap allocation (e.g. for the normalized key cache)
+ */
+static char*
+new_string(i_arena_t *arena, char *orig, long len)
+{
+  char *str = arena == NULL ? xmalloc(len + 1) : arena_alloc_aligned(arena, len + 1, 1);
+  memcpy(str, orig, len);
+  str[len] = '\0';
+  return str;
+}
+
+/*
+ * new_string, unless a parse with a string pool is running
+ */
+static char*
+pooled_string(i_arena_t *arena, char *str, long len)
+{
+  if (arena != NULL && string_pool != NULL)
+    return string_pool_intern(string_pool, str, len, 0);
+  return new_string(arena, str, len);
+}
+
+static void
+set_string_object(i_arena_t *arena, i_object_t *object, char *str, long len)
+{
+  object->type = i_type_string;
+  object->size = len;
+  object->rstring_slot = 0;
+  object->templated = 0;
+  object->data.string = pooled_string(arena, str, len);
+}
+
+static i_object_t*
+new_object(i_arena_t *arena)
+{
+  i_object_t *object;
+  if (arena != NULL && arena->recycled != NULL) {
+    object = arena->recycled;
+    arena->recycled = object->data.array;
+  } else {
+    object = i_alloc(arena, sizeof(i_object_t));
+  }
+  object->rstring_slot = 0;
+  object->templated = 0;
+  return object;
+}
+
+/*
+ * Hands a node that has been copied into place back for reuse. Only for
+ * nodes nothing else points at, i.e. not syck's (which may be aliased)
+ */
+static void
+recycle_object(i_arena_t *arena, i_object_t *object)
+{
+  if (!CAN_FREE(object))
+    return;
+  object->type = i_type_unused;
+  object->data.array = arena->recycled;
+  arena->recycled = object;
+}
+
+/*
+ * Symbols get a slot for their link target right before the name
+ */
+static void
+set_symbol_object(i_arena_t *arena, i_object_t *object, char *str, long len)
+{
+  char *block = arena_alloc(arena, sizeof(i_object_t *) + len + 1);
+  *(i_object_t **)block = NULL;
+  object->type = i_type_symbol;
+  object->size = len;
+  object->rstring_slot = 0;
+  object->templated = 0;
+  object->data.string = block + sizeof(i_object_t *);
+  memcpy(object->data.string, str, len);
+  object->data.string[len] = '\0';
+}
+
+static i_object_t*
+new_symbol_object(i_arena_t *arena, char *str, long len)
+{
+  i_object_t *object = new_object(arena);
+  set_symbol_object(arena, object, str, len);
+  return object;
+}
+
+static i_object_t*
+new_string_object(i_arena_t *arena, char *str, long len)
+{
+  i_object_t *object = new_object(arena);
+  set_string_object(arena, object, str, len);
+  return object;
+}
+
+static int
+is_word_char(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static unsigned long
+scan_word(const char *p, const char *end)
+{
+  const char *start = p;
+  while (p < end && is_word_char(*p))
+    p++;
+  return p - start;
+}
+
+static void
+add_template_segment(i_template_t *template, enum i_segment_type type, unsigned long offset, unsigned long len)
+{
+  if (template == NULL)
+    return;
+  if (type == i_segment_literal && template->num_segments > 0) {
+    i_template_segment_t *last = &template->segments[template->num_segments - 1];
+    if (last->type == i_segment_literal && last->offset + last->len == offset) {
+      last->len += len;
+      template->literal_size += len;
+      return;
+    }
+  }
+  i_template_segment_t *segment = &template->segments[template->num_segments++];
+  segment->type = type;
+  segment->offset = offset;
+  segment->len = len;
+  segment->format_offset = 0;
+  segment->format_len = 0;
+  segment->name = 0;
+  if (type == i_segment_literal)
+    template->literal_size += len;
+  else
+    template->num_placeholders++;
+}
+
+/*
+ * Tokenizes str the way I18n::INTERPOLATION_PATTERN would, i.e.
+ *
+ *   %%  |  %{word}  |  %<word>.*?[bBdiouxXeEfgGcps]
+ *
+ * Fills in template if given. Returns (an upper bound on) the number of
+ * segments, 0 if interpolation can't change str, or -1 if it has to be
+ * left to Ruby (e.g. "%%{scope}", since I18n checks for reserved keys
+ * without regard for escaping).
+ */
+static long
+compile_template(const char *str, unsigned long len, i_template_t *template)
+{
+  const char *p = str,
+             *end = str + len,
+             *literal = str;
+  long num_segments = 0;
+  int changes = 0;
+
+  if (template != NULL) {
+    template->num_segments = 0;
+    template->num_placeholders = 0;
+    template->literal_size = 0;
+  }
+  while ((p = memchr(p, '%', end - p)) != NULL) {
+    const char *next = p + 1;
+    unsigned long word_len = 0;
+    if (next < end && *next == '%') {
+      if (next + 1 < end && next[1] == '{')
+        return -1;
+      // keep the first %, skip the second
+      add_template_segment(template, i_segment_literal, literal - str, p + 1 - literal);
+      literal = p = next + 1;
+      num_segments += 2;
+      changes = 1;
+      continue;
+    }
+    if (next < end && *next == '{') {
+      word_len = scan_word(next + 1, end);
+      if (word_len == 0 || next + 1 + word_len >= end || next[1 + word_len] != '}') {
+        p = next;
+        continue;
+      }
+      if (p > literal)
+        add_template_segment(template, i_segment_literal, literal - str, p - literal);
+      add_template_segment(template, i_segment_placeholder, next + 1 - str, word_len);
+      literal = p = next + word_len + 2;
+      num_segments += 2;
+      changes = 1;
+      continue;
+    }
+    if (next < end && *next == '<') {
+      word_len = scan_word(next + 1, end);
+      const char *format = next + 1 + word_len + 1,
+                 *format_end = format;
+      if (word_len > 0 && format <= end && format[-1] == '>') {
+        while (format_end < end && *format_end != '\n' && strchr("bBdiouxXeEfgGcps", *format_end) == NULL)
+          format_end++;
+        if (format_end < end && *format_end != '\n') {
+          if (p > literal)
+            add_template_segment(template, i_segment_literal, literal - str, p - literal);
+          add_template_segment(template, i_segment_format, next + 1 - str, word_len);
+          if (template != NULL) {
+            template->segments[template->num_segments - 1].format_offset = format - str;
+            template->segments[template->num_segments - 1].format_len = format_end + 1 - format;
+          }
+          literal = p = format_end + 1;
+          num_segments += 2;
+          changes = 1;
+          continue;
+        }
+      }
+    }
+    p = next; // just a %
+  }
+  if (end > literal)
+    add_template_segment(template, i_segment_literal, literal - str, end - literal);
+  return changes ? num_segments + 1 : 0;
+}
+
+/*
+ * Copies str into a block with room for a pointer to its template right
+ * before it, and compiles the template (num_segments is as returned by
+ * compile_template)
+ */
+static char*
+new_templated_string(i_arena_t *arena, char *str, unsigned long len, long num_segments)
+{
+  i_template_t *template = arena_alloc(arena, sizeof(i_template_t) + sizeof(i_template_segment_t) * num_segments);
+  compile_template(str, len, template);
+  char *block = arena_alloc(arena, sizeof(i_template_t *) + len + 1);
+  *(i_template_t **)block = template;
+  memcpy(block + sizeof(i_template_t *), str, len);
+  block[sizeof(i_template_t *) + len] = '\0';
+  return block + sizeof(i_template_t *);
+}
+
+#ifdef HAVE_RUBY_THREAD_NATIVE_H
+#define LOCK_POOL_SHARD(shard) rb_nativethread_lock_lock(&(shard)->lock)
+#define UNLOCK_POOL_SHARD(shard) rb_nativethread_lock_unlock(&(shard)->lock)
+#else
+#define LOCK_POOL_SHARD(shard)
+#define UNLOCK_POOL_SHARD(shard)
+#endif
+
+static uint64_t
+pool_hash(const char *str, unsigned long len)
+{
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a
+  for (unsigned long i = 0; i < len; i++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static void
+grow_pool_shard(i_pool_shard_t *shard)
+{
+  unsigned long capacity = shard->capacity ? shard->capacity * 2 : 256;
+  i_pool_entry_t *entries = xcalloc(capacity, sizeof(i_pool_entry_t));
+  for (unsigned long i = 0; i < shard->capacity; i++) {
+    i_pool_entry_t *entry = &shard->entries[i];
+    if (entry->str == NULL)
+      continue;
+    unsigned long slot = entry->hash & (capacity - 1);
+    while (entries[slot].str != NULL)
+      slot = (slot + 1) & (capacity - 1);
+    entries[slot] = *entry;
+  }
+  xfree(shard->entries);
+  shard->entries = entries;
+  shard->capacity = capacity;
+}
+
+/*
+ * Returns the pooled copy of str, adding it if it's not there yet. If
+ * num_segments is positive, it's a templated string (see
+ * new_templated_string), which is pooled separately from a plain one.
+ * Safe to call without the GVL.
+ */
+static char*
+string_pool_intern(i_string_pool_t *pool, char *str, unsigned long len, long num_segments)
+{
+  int templated = num_segments > 0;
+  uint64_t hash = pool_hash(str, len) ^ templated;
+  i_pool_shard_t *shard = &pool->shards[(hash >> 32) % I_POOL_SHARDS];
+  i_pool_entry_t *entry;
+  char *result;
+
+  LOCK_POOL_SHARD(shard);
+  if ((shard->count + 1) * 2 > shard->capacity)
+    grow_pool_shard(shard);
+  for (unsigned long slot = hash & (shard->capacity - 1); ; slot = (slot + 1) & (shard->capacity - 1)) {
+    entry = &shard->entries[slot];
+    if (entry->str == NULL)
+      break;
+    if (entry->hash == hash && entry->len == len && entry->templated == templated && memcmp(entry->str, str, len) == 0) {
+      shard->hits++;
+      shard->saved += len + 1;
+      if (templated)
+        shard->saved += sizeof(i_template_t *) + sizeof(i_template_t) + sizeof(i_template_segment_t) * num_segments;
+      result = entry->str;
+      UNLOCK_POOL_SHARD(shard);
+      return result;
+    }
+  }
+  if (shard->arena == NULL)
+    shard->arena = new_arena(0);
+  result = templated ? new_templated_string(shard->arena, str, len, num_segments) : new_string(shard->arena, str, len);
+  entry->str = result;
+  entry->len = len;
+  entry->hash = hash;
+  entry->templated = templated;
+  shard->count++;
+  shard->misses++;
+  UNLOCK_POOL_SHARD(shard);
+  return result;
+}
+
+static void
+init_string_pool(i_string_pool_t *pool)
+{
+  memset(pool, 0, sizeof(i_string_pool_t));
+#ifdef HAVE_RUBY_THREAD_NATIVE_H
+  for (int i = 0; i < I_POOL_SHARDS; i++)
+    rb_nativethread_lock_initialize(&pool->shards[i].lock);
+#endif
+}
+
+/*
+ * Throws away every pooled string, so only once nothing points at them
+ * (not in clear_translations, since thaw_snapshot calls it while merging
+ * a tree that may already use the pool)
+ */
+static void
+clear_string_pool(i_string_pool_t *pool)
+{
+  for (int i = 0; i < I_POOL_SHARDS; i++) {
+    i_pool_shard_t *shard = &pool->shards[i];
+    if (shard->arena != NULL)
+      delete_arena(shard->arena);
+    xfree(shard->entries);
+    shard->arena = NULL;
+    shard->entries = NULL;
+    shard->capacity = shard->count = 0;
+    shard->hits = shard->misses = 0;
+    shard->saved = 0;
+  }
+}
+
+/*
+ * Like set_string_object, but a string with interpolations also gets its
+ * template precompiled, with a pointer to it stashed right before the
+ * string itself
+ */
+static void
+set_translation_string_object(i_arena_t *arena, i_object_t *object, char *str, long len)
+{
+  long num_segments = compile_template(str, len, NULL);
+  if (num_segments <= 0) {
+    set_string_object(arena, object, str, len);
+    return;
+  }
+
+  object->type = i_type_string;
+  object->size = len;
+  object->rstring_slot = 0;
+  object->templated = 1;
+  if (string_pool != NULL)
+    object->data.string = string_pool_intern(string_pool, str, len, num_segments);
+  else
+    object->data.string = new_templated_string(arena, str, len, num_segments);
+}
+
+static i_object_t*
+new_translation_string_object(i_arena_t *arena, char *str, long len)
+{
+  i_object_t *object = new_object(arena);
+  set_translation_string_object(arena, object, str, len);
+  return object;
+}
+
+static i_object_t*
+new_array_object(i_arena_t *arena, long size)
+{
+  i_object_t *object = new_object(arena);
+  object->type = i_type_array;
+  object->size = size;
+  object->data.array = i_alloc(arena, sizeof(i_object_t) * size);
+  return object;
+}
+
+static i_object_t*
+new_hash_object(i_arena_t *arena)
+{
+  i_object_t *object = new_object(arena);
+  object->type = i_type_hash;
+  object->data.hash = NULL;
+  return object;
+}
+
+static i_key_value_t*
+new_key_value(i_arena_t *arena, char *key, i_object_t *value)
+{
+  i_key_value_t *kv = i_alloc(arena, sizeof(i_key_value_t));
+  kv->key = key;
+  kv->value = value;
+  return kv;
+}
+
+/*
+ * The key string for a map key node, which syck may have typed as
+ * anything (e.g. `true:` or `~:`), like stringify_keys would
+ */
+static char*
+syck_key(SyckParser *parser, i_object_t *key)
+{
+  i_arena_t *arena = ((i_parse_t *)parser->bonus)->arena;
+  switch (key->type) {
+  case i_type_true:
+    return new_string(arena, (char *)"true", 4);
+  case i_type_false:
+    return new_string(arena, (char *)"false", 5);
+  case i_type_array:
+  case i_type_hash:
+    handle_syck_error(parser, "keys must be scalars");
+    // fall through, the parse is toast anyway
+  case i_type_null:
+    return new_string(arena, (char *)"", 0);
+  default:
+    return key->data.string;
+  }
+}
+
+static SYMID
+handle_syck_node(SyckParser *parser, SyckNode *node)
+{
+  i_parse_t *parse = (i_parse_t *)parser->bonus;
+  i_arena_t *arena = parse->arena;
+  i_object_t *result;
+  SYMID oid;
+
+  switch (node->kind) {
+  case syck_str_kind:
+    if (node->type_id == NULL) {
+      result = new_translation_string_object(arena, node->data.str->ptr, node->data.str->len);
+    } else if (strcmp(node->type_id, "null") == 0) {
+      result = &i_object_null;
+    } else if (strcmp(node->type_id, "bool#yes") == 0) {
+      result = &i_object_true;
+    } else if (strcmp(node->type_id, "bool#no") == 0) {
+      result = &i_object_false;
+    } else if (strcmp(node->type_id, "int") == 0) {
+      syck_str_blow_away_commas(node);
+      result = new_string_object(arena, node->data.str->ptr, node->data.str->len);
+      result->type = i_type_int;
+    } else if (strcmp(node->type_id, "float#fix") == 0 || strcmp(node->type_id, "float#exp") == 0) {
+      syck_str_blow_away_commas(node);
+      result = new_string_object(arena, node->data.str->ptr, node->data.str->len);
+      result->type = i_type_float;
+    } else if (node->data.str->style == scalar_plain && node->data.str->len > 1 && strncmp(node->data.str->ptr, ":", 1) == 0) {
+      result = new_symbol_object(arena, node->data.str->ptr + 1, node->data.str->len - 1);
+    } else {
+      // legit strings, and everything else get the string treatment (binary, int#hex, timestamp, etc.)
+      result = new_translation_string_object(arena, node->data.str->ptr, node->data.str->len);
+    }
+    break;
+  case syck_seq_kind:
+    result = new_array_object(arena, node->data.list->idx);
+    for (long i = 0; i < node->data.list->idx; i++) {
+      i_object_t *item = NULL;
+
+      oid = syck_seq_read(node, i);
+      syck_lookup_sym(parser, oid, (void **)&item);
+      if (item->type == i_type_string)
+        parse->translation_count++;
+      // item may be an alias target, so it stays put
+      memcpy(&result->data.array[i], item, sizeof(i_object_t));
+    }
+    break;
+  case syck_map_kind:
+    result = new_hash_object(arena);
+    for (long i = 0; i < node->data.pairs->idx; i++) {
+      i_object_t *key = NULL, *value = NULL;
+
+      oid = syck_map_read(node, map_key, i);
+      syck_lookup_sym(parser, oid, (void **)&key);
+      oid = syck_map_read(node, map_value, i);
+      syck_lookup_sym(parser, oid, (void **)&value);
+
+      i_key_value_t *kv = new_key_value(arena, syck_key(parser, key), value);
+      if (value->type == i_type_string)
+        parse->translation_count++;
+      add_key_value(&result->data.hash, kv);
+    }
+    break;
+  default:
+    result = &i_object_null;
+    break;
+  }
+
+  return syck_add_sym(parser, (char *)result);
+}
+
+/*
+ * read_yml is a loader for the subset of yml that translation files
+ * actually use: block mappings and sequences, plain, quoted and block
+ * scalars, single line flow sequences, and comments. It builds the tree
+ * directly in the arena as it goes, rather than having syck allocate a
+ * node per scalar, register it in a symbol table, and then copy it over.
+ *
+ * Anything outside that subset (anchors, tags, multi-line plain or quoted
+ * scalars, most escapes, ambiguous implicit types, syntax errors, etc.)
+ * bails, and parse_yml hands the whole thing to syck, so results and
+ * error messages are the same either way.
+ */
+enum i_yml_plain_type {
+  i_yml_str,
+  i_yml_null,
+  i_yml_true,
+  i_yml_false,
+  i_yml_int,
+  i_yml_float,
+  i_yml_unknown // might be one of syck's other implicit types
+};
+
+static void
+yml_bail(i_yml_reader_t *reader)
+{
+  longjmp(reader->bail, 1);
+}
+
+static const char*
+yml_eol(i_yml_reader_t *reader, const char *p)
+{
+  const char *eol = memchr(p, '\n', reader->end - p);
+  return eol == NULL ? reader->end : eol;
+}
+
+static const char*
+yml_next_line(i_yml_reader_t *reader, const char *p)
+{
+  const char *eol = yml_eol(reader, p);
+  return eol == reader->end ? eol : eol + 1;
+}
+
+static void
+yml_scratch_append(i_yml_reader_t *reader, const char *str, long len)
+{
+  if (reader->scratch_len + len > reader->scratch_size) {
+    long size = reader->scratch_size ? reader->scratch_size : 256;
+    while (size < reader->scratch_len + len)
+      size *= 2;
+    char *scratch = realloc(reader->scratch, size);
+    if (scratch == NULL)
+      yml_bail(reader);
+    reader->scratch = scratch;
+    reader->scratch_size = size;
+  }
+  memcpy(reader->scratch + reader->scratch_len, str, len);
+  reader->scratch_len += len;
+}
+
+static void
+yml_push_item(i_yml_reader_t *reader, i_object_t *item)
+{
+  if (reader->num_items == reader->items_size) {
+    long size = reader->items_size ? reader->items_size * 2 : 16;
+    i_object_t *items = realloc(reader->items, size * sizeof(i_object_t));
+    if (items == NULL)
+      yml_bail(reader);
+    reader->items = items;
+    reader->items_size = size;
+  }
+  if (item->type == i_type_string)
+    reader->parse->translation_count++;
+  memcpy(&reader->items[reader->num_items++], item, sizeof(i_object_t));
+  if (CAN_FREE(item))
+    recycle_object(reader->parse->arena, item); // like handle_syck_node, we only need the copy
+}
+
+/*
+ * Skips blank and comment lines, and returns the indentation of the next
+ * one (or -1 if there isn't one)
+ */
+static long
+yml_next_indent(i_yml_reader_t *reader)
+{
+  while (reader->line < reader->end) {
+    const char *p = reader->line;
+    while (p < reader->end && *p == ' ')
+      p++;
+    if (p < reader->end && *p == '\t')
+      yml_bail(reader);
+    if (p < reader->end && *p != '\n' && *p != '#')
+      return p - reader->line;
+    reader->line = yml_next_line(reader, p);
+  }
+  return -1;
+}
+
+/*
+ * Whatever follows a scalar on its line can only be a comment
+ */
+static void
+yml_expect_eol(i_yml_reader_t *reader, const char *p, const char *eol)
+{
+  const char *start = p;
+  while (p < eol && *p == ' ')
+    p++;
+  if (p < eol && (*p != '#' || p == start))
+    yml_bail(reader);
+  reader->line = eol == reader->end ? eol : eol + 1;
+}
+
+/*
+ * The line after a scalar can't be indented further than its key, or it
+ * would be a continuation of it (or an error)
+ */
+static void
+yml_expect_dedent(i_yml_reader_t *reader, long indent)
+{
+  if (yml_next_indent(reader) > indent)
+    yml_bail(reader);
+}
+
+static int
+yml_match(const char *str, long len, const char **words)
+{
+  for (; *words != NULL; words++) {
+    if ((long)strlen(*words) == len && strncmp(str, *words, len) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+static int
+yml_digits(const char *p, const char *end)
+{
+  const char *start = p;
+  while (p < end && *p >= '0' && *p <= '9')
+    p++;
+  return p == end && p > start;
+}
+
+/*
+ * The implicit types that handle_syck_node cares about. Rather than
+ * reproduce all of syck's rules for numbers and timestamps, anything that
+ * isn't obviously a plain int/float or a string is left to syck.
+ */
+static enum i_yml_plain_type
+yml_plain_type(const char *str, long len)
+{
+  static const char *nulls[] = {"~", "null", "Null", "NULL", NULL},
+                    *trues[] = {"yes", "Yes", "YES", "true", "True", "TRUE", "on", "On", "ON", NULL},
+                    *falses[] = {"no", "No", "NO", "false", "False", "FALSE", "off", "Off", "OFF", NULL};
+  const char *end = str + len, *dot;
+
+  if (len == 0 || yml_match(str, len, nulls))
+    return i_yml_null;
+  if (yml_match(str, len, trues))
+    return i_yml_true;
+  if (yml_match(str, len, falses))
+    return i_yml_false;
+  if (!(*str >= '0' && *str <= '9') && *str != '-' && *str != '+' && *str != '.')
+    return i_yml_str;
+
+  if (yml_digits(str, end) && (*str != '0' || len == 1))
+    return i_yml_int;
+  dot = memchr(str, '.', len);
+  if (dot != NULL && yml_digits(str, dot) && (*str != '0' || dot == str + 1) && yml_digits(dot + 1, end))
+    return i_yml_float;
+  for (const char *p = str; p < end; p++) {
+    if (strchr("0123456789abcdefABCDEFxX+-.,:_ tTzZ", *p) == NULL)
+      return i_yml_str;
+  }
+  return i_yml_unknown;
+}
+
+/*
+ * Sets *str and *len to the contents of the quoted scalar at p (unescaping
+ * into scratch if need be), and returns the position after it
+ */
+static const char*
+yml_quoted(i_yml_reader_t *reader, const char *p, const char *eol, const char **str, long *len)
+{
+  char quote = *p++;
+  const char *start = p, *run = p;
+  int escaped = 0;
+
+  reader->scratch_len = 0;
+  for (; p < eol; p++) {
+    if (*p == quote) {
+      if (quote == '\'' && p + 1 < eol && p[1] == '\'') {
+        yml_scratch_append(reader, run, p + 1 - run);
+        run = ++p + 1;
+        escaped = 1;
+        continue;
+      }
+      break;
+    }
+    if (quote == '"' && *p == '\\') {
+      const char *replacement;
+      if (p + 1 == eol)
+        yml_bail(reader);
+      switch (p[1]) {
+      case '\\': replacement = "\\"; break;
+      case '"': replacement = "\""; break;
+      case 'n': replacement = "\n"; break;
+      case 't': replacement = "\t"; break;
+      default: yml_bail(reader); return NULL;
+      }
+      yml_scratch_append(reader, run, p - run);
+      yml_scratch_append(reader, replacement, 1);
+      run = ++p + 1;
+      escaped = 1;
+    }
+  }
+  if (p == eol)
+    yml_bail(reader); // multi-line
+  if (escaped) {
+    yml_scratch_append(reader, run, p - run);
+    *str = reader->scratch;
+    *len = reader->scratch_len;
+  } else {
+    *str = start;
+    *len = p - start;
+  }
+  return p + 1;
+}
+
+/*
+ * Sets *key to a copy of the (plain or quoted) key at p, and returns the
+ * position of its value
+ */
+static const char*
+yml_key(i_yml_reader_t *reader, const char *p, char **key)
+{
+  const char *eol = yml_eol(reader, p), *str = p;
+  long len;
+
+  if (*p == '"' || *p == '\'') {
+    p = yml_quoted(reader, p, eol, &str, &len);
+    if (p == eol || *p != ':' || (p + 1 < eol && p[1] != ' '))
+      yml_bail(reader);
+  } else {
+    if (strchr("-?:,[]{}#&*!|>%@`", *p) != NULL && !(*p == ':' && p + 1 < eol && p[1] != ' '))
+      yml_bail(reader);
+    for (; p < eol; p++) {
+      if (*p == ':' && (p + 1 == eol || p[1] == ' '))
+        break;
+      if (*p == '\t' || (*p == '#' && p[-1] == ' '))
+        yml_bail(reader);
+    }
+    if (p == eol)
+      yml_bail(reader);
+    len = p - str;
+    while (len > 0 && str[len - 1] == ' ')
+      len--;
+    switch (yml_plain_type(str, len)) {
+    case i_yml_str:
+    case i_yml_int:
+    case i_yml_float:
+      break;
+    default:
+      yml_bail(reader); // a null/bool key is never what you want
+    }
+    if (*str == ':' && len > 1) { // symbol keys are just strings
+      str++;
+      len--;
+    }
+  }
+  *key = pooled_string(reader->parse->arena, (char *)str, len);
+  for (p++; p < eol && *p == ' '; p++);
+  return p;
+}
+
+static i_object_t*
+yml_plain(i_yml_reader_t *reader, const char *str, long len)
+{
+  i_arena_t *arena = reader->parse->arena;
+  i_object_t *object;
+
+  switch (yml_plain_type(str, len)) {
+  case i_yml_null:
+    return &i_object_null;
+  case i_yml_true:
+    return &i_object_true;
+  case i_yml_false:
+    return &i_object_false;
+  case i_yml_int:
+    object = new_string_object(arena, (char *)str, len);
+    object->type = i_type_int;
+    return object;
+  case i_yml_float:
+    object = new_string_object(arena, (char *)str, len);
+    object->type = i_type_float;
+    return object;
+  case i_yml_str:
+    if (*str == ':' && len > 1) {
+      return new_symbol_object(arena, (char *)str + 1, len - 1);
+    }
+    return new_translation_string_object(arena, (char *)str, len);
+  default:
+    yml_bail(reader);
+    return NULL;
+  }
+}
+
+/*
+ * [foo, "bar", baz], all on one line
+ */
+static i_object_t*
+yml_flow_sequence(i_yml_reader_t *reader, const char *p, const char *eol)
+{
+  long base = reader->num_items;
+  const char *str;
+  long len;
+
+  for (p++; p < eol && *p == ' '; p++);
+  while (p < eol && *p != ']') {
+    if (*p == '"' || *p == '\'') {
+      p = yml_quoted(reader, p, eol, &str, &len);
+      yml_push_item(reader, new_translation_string_object(reader->parse->arena, (char *)str, len));
+    } else {
+      if (strchr("-?:,[]{}#&*!|>%@`", *p) != NULL)
+        yml_bail(reader);
+      for (str = p; p < eol && *p != ',' && *p != ']'; p++) {
+        if (strchr("[{}\t", *p) != NULL || (*p == ':' && p + 1 < eol && p[1] == ' ') || (*p == '#' && p[-1] == ' '))
+          yml_bail(reader);
+      }
+      for (len = p - str; str[len - 1] == ' '; len--);
+      yml_push_item(reader, yml_plain(reader, str, len));
+    }
+    for (; p < eol && *p == ' '; p++);
+    if (p < eol && *p == ',')
+      for (p++; p < eol && *p == ' '; p++);
+    else if (p == eol || *p != ']')
+      yml_bail(reader);
+    else
+      break;
+    if (p < eol && *p == ']')
+      yml_bail(reader); // trailing comma
+  }
+  if (p == eol)
+    yml_bail(reader);
+
+  i_object_t *array = new_array_object(reader->parse->arena, reader->num_items - base);
+  memcpy(array->data.array, reader->items + base, sizeof(i_object_t) * array->size);
+  reader->num_items = base;
+  yml_expect_eol(reader, p + 1, eol);
+  return array;
+}
+
+/*
+ * Literal (|) and folded (>) scalars, optionally with the strip chomping
+ * indicator. Folded ones can't have blank or more indented lines, as
+ * that's where syck's folding gets creative.
+ */
+static i_object_t*
+yml_block_scalar(i_yml_reader_t *reader, const char *p, const char *eol, long parent_indent)
+{
+  int folded = *p++ == '>',
+      strip = 0;
+  long indent = -1, blank_lines = 0;
+
+  if (p < eol && *p == '-') {
+    strip = 1;
+    p++;
+  }
+  if (p < eol && *p != ' ')
+    yml_bail(reader); // keep chomping, indentation indicators, etc.
+  yml_expect_eol(reader, p, eol);
+
+  reader->scratch_len = 0;
+  while (reader->line < reader->end) {
+    const char *line = reader->line;
+    for (p = line; p < reader->end && *p == ' '; p++);
+    eol = yml_eol(reader, p);
+    if (p == eol) {
+      if (indent < 0 || p - line > indent)
+        yml_bail(reader);
+      blank_lines++;
+      reader->line = eol == reader->end ? eol : eol + 1;
+      continue;
+    }
+    if (indent < 0) {
+      if (p - line <= parent_indent)
+        yml_bail(reader);
+      indent = p - line;
+    }
+    if (p - line < indent)
+      break;
+    if (eol == reader->end)
+      yml_bail(reader); // no trailing newline
+    if (folded) {
+      if (p - line > indent || blank_lines > 0)
+        yml_bail(reader);
+      if (reader->scratch_len > 0)
+        yml_scratch_append(reader, " ", 1);
+      yml_scratch_append(reader, p, eol - p);
+    } else {
+      for (; blank_lines > 0; blank_lines--)
+        yml_scratch_append(reader, "\n", 1);
+      yml_scratch_append(reader, line + indent, eol + 1 - (line + indent));
+    }
+    blank_lines = 0;
+    reader->line = eol + 1;
+  }
+  if (indent < 0)
+    yml_bail(reader);
+  if (folded && !strip)
+    yml_scratch_append(reader, "\n", 1);
+  if (!folded && strip)
+    reader->scratch_len--;
+  return new_translation_string_object(reader->parse->arena, reader->scratch, reader->scratch_len);
+}
+
+static int
+yml_sequence_entry(i_yml_reader_t *reader, const char *p)
+{
+  return *p == '-' && (p + 1 == reader->end || p[1] == ' ' || p[1] == '\n');
+}
+
+static i_object_t* yml_block(i_yml_reader_t *reader, long indent, int depth);
+
+/*
+ * The value at p, which is either on the same line as its key (or -), or
+ * a block on the lines that follow
+ */
+static i_object_t*
+yml_value(i_yml_reader_t *reader, const char *p, long indent, int in_mapping, int depth)
+{
+  const char *eol = yml_eol(reader, p), *str;
+  long len, next_indent;
+  i_object_t *object;
+
+  if (p == eol || *p == '#') {
+    reader->line = eol == reader->end ? eol : eol + 1;
+    next_indent = yml_next_indent(reader);
+    if (next_indent > indent)
+      return yml_block(reader, next_indent, depth + 1);
+    if (in_mapping && next_indent == indent && yml_sequence_entry(reader, reader->line + indent))
+      return yml_block(reader, next_indent, depth + 1); // key:\n- item
+    return &i_object_null;
+  }
+
+  switch (*p) {
+  case '"':
+  case '\'':
+    p = yml_quoted(reader, p, eol, &str, &len);
+    object = new_translation_string_object(reader->parse->arena, (char *)str, len);
+    yml_expect_eol(reader, p, eol);
+    break;
+  case '[':
+    object = yml_flow_sequence(reader, p, eol);
+    break;
+  case '{':
+    if (p + 1 == eol || p[1] != '}')
+      yml_bail(reader);
+    object = new_hash_object(reader->parse->arena);
+    yml_expect_eol(reader, p + 2, eol);
+    break;
+  case '|':
+  case '>':
+    return yml_block_scalar(reader, p, eol, indent);
+  default:
+    if (strchr("-?,]}&*!%@`", *p) != NULL && (*p != '-' || p + 1 == eol || p[1] == ' '))
+      yml_bail(reader);
+    for (str = p; p < eol; p++) {
+      if (*p == '\t' || (*p == ':' && (p + 1 == eol || p[1] == ' ')))
+        yml_bail(reader);
+      if (*p == '#' && p[-1] == ' ')
+        break;
+    }
+    for (len = p - str; str[len - 1] == ' '; len--);
+    object = yml_plain(reader, str, len);
+    reader->line = eol == reader->end ? eol : eol + 1;
+  }
+  yml_expect_dedent(reader, indent);
+  return object;
+}
+
+static i_object_t*
+yml_mapping(i_yml_reader_t *reader, long indent, int depth)
+{
+  i_object_t *hash = new_hash_object(reader->parse->arena);
+  long next_indent;
+
+  while ((next_indent = yml_next_indent(reader)) == indent) {
+    const char *p = reader->line + indent;
+    char *key;
+    if (indent == 0 && (strncmp(p, "---", 3) == 0 || strncmp(p, "...", 3) == 0))
+      yml_bail(reader); // another document
+    p = yml_key(reader, p, &key);
+    i_object_t *value = yml_value(reader, p, indent, 1, depth);
+    if (value->type == i_type_string)
+      reader->parse->translation_count++;
+    add_key_value(&hash->data.hash, new_key_value(reader->parse->arena, key, value));
+  }
+  if (next_indent > indent)
+    yml_bail(reader);
+  return hash;
+}
+
+static i_object_t*
+yml_sequence(i_yml_reader_t *reader, long indent, int depth)
+{
+  long base = reader->num_items;
+
+  while (yml_next_indent(reader) == indent) {
+    const char *p = reader->line + indent;
+    if (!yml_sequence_entry(reader, p))
+      break; // the next key of the mapping we're in (same indentation)
+    for (p++; p < reader->end && *p == ' '; p++);
+    yml_push_item(reader, yml_value(reader, p, indent, 0, depth));
+  }
+
+  i_object_t *array = new_array_object(reader->parse->arena, reader->num_items - base);
+  memcpy(array->data.array, reader->items + base, sizeof(i_object_t) * array->size);
+  reader->num_items = base;
+  return array;
+}
+
+static i_object_t*
+yml_block(i_yml_reader_t *reader, long indent, int depth)
+{
+  if (depth > I_YML_MAX_DEPTH)
+    yml_bail(reader);
+  if (yml_sequence_entry(reader, reader->line + indent))
+    return yml_sequence(reader, indent, depth);
+  return yml_mapping(reader, indent, depth);
+}
+
+/*
+ * Parses yml into parse->arena, returning the root hash, or NULL if it
+ * needs syck
+ */
+static i_object_t*
+read_yml(i_parse_t *parse, const char *yml, long len)
+{
+  i_yml_reader_t *reader;
+  i_object_t *root;
+  long indent;
+
+  if (memchr(yml, '\r', len) != NULL || memchr(yml, '\0', len) != NULL || (len >= 3 && memcmp(yml, "\xEF\xBB\xBF", 3) == 0))
+    return NULL;
+  reader = calloc(1, sizeof(i_yml_reader_t)); // rather than a local, since longjmp clobbers those
+  if (reader == NULL)
+    return NULL;
+  reader->parse = parse;
+  reader->line = yml;
+  reader->end = yml + len;
+
+  uthash_arena = parse->arena;
+  string_pool = parse->pool;
+  if (setjmp(reader->bail) == 0) {
+    indent = yml_next_indent(reader);
+    if (indent == 0 && strncmp(reader->line, "---", 3) == 0)
+      yml_expect_eol(reader, reader->line + 3, yml_eol(reader, reader->line));
+    indent = yml_next_indent(reader);
+    if (indent >= 0) {
+      reader->root = yml_block(reader, indent, 0);
+      if (reader->root->type != i_type_hash || yml_next_indent(reader) >= 0)
+        reader->root = NULL;
+    }
+  }
+  uthash_arena = NULL;
+  string_pool = NULL;
+  root = reader->root;
+  free(reader->scratch);
+  free(reader->items);
+  free(reader);
+  return root;
+}
+
+/*
+ *  call-seq:
+ *     backend.load_yaml_string(yaml_str) -> num_translations
+ *
+ *  Loads translations from the specified yaml string, and returns the
+ *  number of (new) translations stored.
+ *
+ *     backend.load_yaml_string("en:\n  foo: bar")   #=> 1
+ */
+
+static VALUE
+run_syck_parse(VALUE parser)
+{
+  return (VALUE)syck_parse((SyckParser *)parser);
+}
+
+/*
+ * Parses yml into a new tree in parse->arena (with read_yml if it can,
+ * otherwise syck), returning its root (or NULL if there was an error or
+ * the root isn't a hash). Note that parse->arena may get replaced (or
+ * freed, if the parse raises).
+ */
+static i_object_t*
+parse_yml(i_parse_t *parse, char *yml, long len)
+{
+  SYMID oid;
+  int state, translation_count = parse->translation_count;
+  i_object_t *root = read_yml(parse, yml, len);
+  if (root != NULL)
+    return root;
+
+  // start over; the arena is just for this parse, so drop whatever
+  // read_yml got through
+  parse->translation_count = translation_count;
+  if (parse->arena->used > 0) {
+    delete_arena(parse->arena);
+    parse->arena = new_arena(len);
+  }
+  SyckParser *parser = syck_new_parser();
+  parser->bonus = parse;
+  syck_parser_handler(parser, handle_syck_node);
+  syck_parser_str(parser, yml, len, NULL);
+  syck_parser_bad_anchor_handler(parser, handle_syck_badanchor);
+  syck_parser_error_handler(parser, handle_syck_error);
+
+  // syck errors raise (see handle_syck_error), as can anything that
+  // allocates, and the thread locals mustn't outlive the arena
+  uthash_arena = parse->arena;
+  string_pool = parse->pool;
+  oid = (SYMID)rb_protect(run_syck_parse, (VALUE)parser, &state);
+  uthash_arena = NULL;
+  string_pool = NULL;
+  if (state) {
+    syck_free_parser(parser);
+    delete_arena(parse->arena);
+    parse->arena = NULL;
+    rb_jump_tag(state);
+  }
+  syck_lookup_sym(parser, oid, (void **)&root);
+  syck_free_parser(parser);
+  if (parse->failed || root == NULL || root->type != i_type_hash)
+    return NULL;
+  return root;
+}
+
+/*
+ * The sub-second part of st's mtime, so that reload_changed! notices a
+ * same-size edit made within the same second as the last load
+ */
+static long
+stat_mtime_nsec(const struct stat *st)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+  return st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+  return st->st_mtimespec.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+static i_source_t*
+new_source(const char *path, char *yml, long len, struct stat *st)
+{
+  i_source_t *source = ALLOC(i_source_t);
+  memset(source, 0, sizeof(i_source_t));
+  source->reparseable = 1;
+  if (path != NULL) {
+    source->path = new_string(NULL, (char *)path, strlen(path));
+    source->mtime = st->st_mtime;
+    source->mtime_nsec = stat_mtime_nsec(st);
+    source->size = st->st_size;
+  } else if (yml != NULL) {
+    source->yml = new_string(NULL, yml, len);
+    source->yml_len = len;
+  } else {
+    source->reparseable = 0;
+  }
+  return source;
+}
+
+static void
+delete_source(i_source_t *source)
+{
+  xfree(source->path);
+  xfree(source->locale);
+  xfree(source->yml);
+  xfree(source->tree);
+  xfree(source);
+}
+
+/*
+ * Lists the subtrees in root (see i_source_t) into a buffer in arena.
+ * Returns 0 if root has a locale that isn't a hash, in which case there
+ * is no telling its subtrees apart.
+ */
+static int
+source_subtrees(i_arena_t *arena, i_object_t *root, char **subtrees, unsigned long *num_subtrees)
+{
+  size_t size = 0;
+  char *id;
+  *num_subtrees = 0;
+  for (i_key_value_t *locale = root->data.hash; locale != NULL; locale = locale->hh.next) {
+    if (locale->value->type != i_type_hash)
+      return 0;
+    size += locale->hh.keylen + 1;
+    (*num_subtrees)++;
+    for (i_key_value_t *kv = locale->value->data.hash; kv != NULL; kv = kv->hh.next) {
+      size += locale->hh.keylen + 1 + kv->hh.keylen + 1;
+      (*num_subtrees)++;
+    }
+  }
+
+  id = *subtrees = arena_alloc_aligned(arena, size, 1);
+  for (i_key_value_t *locale = root->data.hash; locale != NULL; locale = locale->hh.next) {
+    memcpy(id, locale->key, locale->hh.keylen + 1);
+    id += locale->hh.keylen + 1;
+    for (i_key_value_t *kv = locale->value->data.hash; kv != NULL; kv = kv->hh.next) {
+      memcpy(id, locale->key, locale->hh.keylen);
+      id += locale->hh.keylen;
+      *id++ = (char)I_PATH_SEPARATOR;
+      memcpy(id, kv->key, kv->hh.keylen + 1);
+      id += kv->hh.keylen + 1;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Records source (and the subtrees of root) as the newest thing loaded
+ */
+static void
+add_source(i_translations_t *store, i_source_t *source, i_arena_t *arena, i_object_t *root)
+{
+  source->arena = arena;
+  if (!source_subtrees(arena, root, &source->subtrees, &source->num_subtrees))
+    store->incremental = 0;
+  *store->last_source = source;
+  store->last_source = &source->next;
+}
+
+/*
+ * Merges a freshly parsed tree into the store, which takes over its arena
+ * (and source)
+ */
+static void
+merge_translations(i_translations_t *store, i_arena_t *arena, i_object_t *root, i_source_t *source)
+{
+  i_cold_locale_t *cold;
+  if (store->snapshot != NULL)
+    thaw_snapshot(store);
+  // compressed locales have to be back in the tree to be merged into
+  for (i_key_value_t *locale = root->data.hash; locale != NULL && store->cold_locales != NULL; locale = locale->hh.next) {
+    HASH_FIND(hh, store->cold_locales, locale->key, locale->hh.keylen, cold);
+    if (cold != NULL && cold->blob != NULL)
+      warm_cold_locale(store, cold);
+  }
+  add_source(store, source, arena, root);
+  uthash_arena = arena;
+  merge_string_cache = &store->string_cache;
+  merge_hash(&store->root, root);
+  translations_changed(store);
+  uthash_arena = NULL;
+  merge_string_cache = NULL;
+  arena->recycled = NULL;
+  arena->next = store->arenas;
+  store->arenas = arena;
+}
+
+static VALUE
+load_yml_string(VALUE self, VALUE yml)
+{
+  i_translations_t *store = writable_store(self);
+  i_parse_t parse = {.arena = NULL, .translation_count = 0, .raise = 1, .failed = 0, .pool = store->pool.enabled ? &store->pool : NULL};
+  i_source_t *source;
+  i_object_t *root;
+
+  StringValue(yml);
+  parse.arena = new_arena(RSTRING_LEN(yml));
+  root = parse_yml(&parse, RSTRING_PTR(yml), RSTRING_LEN(yml));
+  if (root == NULL) {
+    delete_arena(parse.arena);
+    rb_raise(I18nemaBackendLoadError, "root yml node is not a hash");
+  }
+  // without keep_sources, reload_changed! can't re-parse it, so it reload!s
+  if (store->keep_sources)
+    source = new_source(NULL, RSTRING_PTR(yml), RSTRING_LEN(yml), NULL);
+  else
+    source = new_source(NULL, NULL, 0, NULL);
+  merge_translations(store, parse.arena, root, source);
+  return INT2NUM(parse.translation_count);
+}
+
+/*
+ * State for load_hash's walk of a ruby Hash
+ */
+typedef struct i_hash_load
+{
+  i_parse_t *parse;
+  i_object_t *hash;
+  int depth;
+} i_hash_load_t;
+
+static void robject_to_object(i_parse_t *parse, VALUE value, i_object_t *target, int depth);
+
+static char*
+rkey_to_key(i_arena_t *arena, VALUE key)
+{
+  if (SYMBOL_P(key)) {
+    const char *name = rb_id2name(SYM2ID(key));
+    return pooled_string(arena, (char *)name, strlen(name));
+  }
+  key = rb_obj_as_string(key);
+  return pooled_string(arena, RSTRING_PTR(key), RSTRING_LEN(key));
+}
+
+static int
+rhash_to_hash_i(VALUE key, VALUE value, VALUE arg)
+{
+  i_hash_load_t *load = (i_hash_load_t *)arg;
+  i_arena_t *arena = load->parse->arena;
+  i_object_t *object = new_object(arena);
+  char *kv_key = rkey_to_key(arena, key);
+
+  robject_to_object(load->parse, value, object, load->depth);
+  if (object->type == i_type_string)
+    load->parse->translation_count++;
+  add_key_value(&load->hash->data.hash, new_key_value(arena, kv_key, object));
+  return ST_CONTINUE;
+}
+
+/*
+ * Copies value into target, the same way it'd come out of its yml (keys
+ * get stringified, Strings precompiled, etc.). Anything that isn't a
+ * Hash/Array/String/Symbol/Numeric/true/false/nil gets stored as its to_s
+ */
+static void
+robject_to_object(i_parse_t *parse, VALUE value, i_object_t *target, int depth)
+{
+  i_arena_t *arena = parse->arena;
+  VALUE str;
+
+  if (depth > I_YML_MAX_DEPTH)
+    rb_raise(I18nemaBackendLoadError, "translations are nested too deeply");
+  target->rstring_slot = 0;
+  target->templated = 0;
+  switch (TYPE(value)) {
+  case T_HASH: {
+    i_hash_load_t load = {parse, target, depth + 1};
+    target->type = i_type_hash;
+    target->data.hash = NULL;
+    rb_hash_foreach(value, rhash_to_hash_i, (VALUE)&load);
+    break;
+  }
+  case T_ARRAY:
+    target->type = i_type_array;
+    target->size = RARRAY_LEN(value);
+    target->data.array = i_alloc(arena, sizeof(i_object_t) * target->size);
+    for (unsigned long i = 0; i < target->size; i++) {
+      // to_s could change the array under us, so no RARRAY_PTR
+      robject_to_object(parse, rb_ary_entry(value, i), &target->data.array[i], depth + 1);
+      if (target->data.array[i].type == i_type_string)
+        parse->translation_count++;
+    }
+    break;
+  case T_SYMBOL: {
+    const char *name = rb_id2name(SYM2ID(value));
+    set_symbol_object(arena, target, (char *)name, strlen(name));
+    break;
+  }
+  case T_NIL:
+    target->type = i_type_null;
+    break;
+  case T_TRUE:
+    target->type = i_type_true;
+    break;
+  case T_FALSE:
+    target->type = i_type_false;
+    break;
+  case T_FIXNUM:
+  case T_BIGNUM:
+  case T_FLOAT:
+    str = rb_obj_as_string(value);
+    set_string_object(arena, target, RSTRING_PTR(str), RSTRING_LEN(str));
+    target->type = TYPE(value) == T_FLOAT ? i_type_float : i_type_int;
+    break;
+  default:
+    str = TYPE(value) == T_STRING ? value : rb_obj_as_string(value);
+    str = rb_str_conv_enc(str, rb_enc_get(str), rb_utf8_encoding());
+    set_translation_string_object(arena, target, RSTRING_PTR(str), RSTRING_LEN(str));
+    break;
+  }
+}
+
+static VALUE
+walk_hash_load(VALUE arg)
+{
+  VALUE *args = (VALUE *)arg;
+  // i.e. {locale => hash}
+  rhash_to_hash_i(args[0], args[1], args[2]);
+  return Qnil;
+}
+
+/*
+ *  call-seq:
+ *     backend.load_hash(locale, hash) -> num_translations
+ *
+ *  Merges hash into locale's translations, same as load_yml_string would
+ *  with it as yml (the merge rules and count are the same), but without
+ *  the round trip through yml. store_translations uses this.
+ */
+
+static VALUE
+load_hash(VALUE self, VALUE locale, VALUE hash)
+{
+  i_translations_t *store = writable_store(self);
+  i_parse_t parse = {.arena = NULL, .translation_count = 0, .raise = 1, .failed = 0, .pool = store->pool.enabled ? &store->pool : NULL};
+  i_source_t *source;
+  i_object_t *root;
+  int state;
+
+  parse.arena = new_arena(0);
+  root = new_hash_object(parse.arena);
+  i_hash_load_t load = {&parse, root, 0};
+  VALUE args[3] = {locale, hash, (VALUE)&load};
+  uthash_arena = parse.arena;
+  string_pool = parse.pool;
+  rb_protect(walk_hash_load, (VALUE)args, &state);
+  uthash_arena = NULL;
+  string_pool = NULL;
+  if (state) {
+    delete_arena(parse.arena);
+    rb_jump_tag(state);
+  }
+
+  // there's no yml to re-parse, so reload_changed! thaws a copy instead
+  source = new_source(NULL, NULL, 0, NULL);
+  if (store->keep_sources) {
+    source->tree = build_snapshot(root, "", 0);
+    source->reparseable = 1;
+  }
+  merge_translations(store, parse.arena, root, source);
+  return INT2NUM(parse.translation_count);
+}
+
+/*
+ * Returns the contents of the file at path (to be freed), or NULL with
+ * errno set. st gets the stat of what was actually read.
+ */
+static char*
+read_file(const char *path, long *len, struct stat *st)
+{
+  char *data = NULL;
+  long size = 0;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, st) == 0 && (data = malloc(st->st_size + 1)) != NULL) {
+    while (size < st->st_size) {
+      ssize_t n = read(fd, data + size, st->st_size - size);
+      if (n <= 0)
+        break;
+      size += n;
+    }
+    if (size < st->st_size) {
+      free(data);
+      data = NULL;
+    } else {
+      data[size] = '\0';
+    }
+  }
+  close(fd);
+  *len = size;
+  return data;
+}
+
+/*
+ * Deep copies object into parse's arena (into target, or a new object if
+ * NULL), counting its translations along the way
+ */
+static i_object_t*
+copy_object(i_parse_t *parse, i_object_t *object, i_object_t *target)
+{
+  i_arena_t *arena = parse->arena;
+  if (target == NULL) {
+    if (!CAN_FREE(object))
+      return object;
+    target = new_object(arena);
+  }
+  switch (object->type) {
+  case i_type_hash:
+    target->type = i_type_hash;
+    target->data.hash = NULL;
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next) {
+      i_object_t *value = copy_object(parse, kv->value, NULL);
+      if (value->type == i_type_string)
+        parse->translation_count++;
+      add_key_value(&target->data.hash, new_key_value(arena, pooled_string(arena, kv->key, strlen(kv->key)), value));
+    }
+    break;
+  case i_type_array:
+    target->type = i_type_array;
+    target->size = object->size;
+    target->data.array = i_alloc(arena, sizeof(i_object_t) * object->size);
+    for (unsigned long i = 0; i < object->size; i++) {
+      copy_object(parse, &object->data.array[i], &target->data.array[i]);
+      if (object->data.array[i].type == i_type_string)
+        parse->translation_count++;
+    }
+    break;
+  case i_type_string:
+    set_translation_string_object(arena, target, object->data.string, object->size);
+    break;
+  case i_type_symbol:
+    set_symbol_object(arena, target, object->data.string, object->size);
+    break;
+  case i_type_true:
+  case i_type_false:
+  case i_type_null:
+    target->type = object->type;
+    break;
+  default:
+    set_string_object(arena, target, object->data.string, object->size);
+    target->type = object->type;
+    break;
+  }
+  return target;
+}
+
+/*
+ * Drops everything but locale from a freshly parsed root. If there was
+ * anything else, locale's translations get copied into an arena of their
+ * own (replacing parse's), so the rest of the file isn't kept around or
+ * counted. Returns the new root.
+ */
+static i_object_t*
+keep_only_locale(i_parse_t *parse, i_object_t *root, const char *locale)
+{
+  i_key_part_t part = {locale, strlen(locale)};
+  i_object_t *value = hash_get(root, &part, 1);
+  i_arena_t *arena = parse->arena;
+
+  if (value != NULL && HASH_COUNT(root->data.hash) == 1)
+    return root;
+  parse->arena = new_arena(0);
+  parse->translation_count = 0;
+  uthash_arena = parse->arena;
+  string_pool = parse->pool;
+  root = new_hash_object(parse->arena);
+  if (value != NULL) {
+    value = copy_object(parse, value, NULL);
+    if (value->type == i_type_string)
+      parse->translation_count++;
+    add_key_value(&root->data.hash, new_key_value(parse->arena, new_string(parse->arena, (char *)locale, part.len), value));
+  }
+  uthash_arena = NULL;
+  string_pool = NULL;
+  delete_arena(arena);
+  return root;
+}
+
+/*
+ *  call-seq:
+ *     backend.load_yml_file(path, locale = nil) -> num_translations
+ *
+ *  Same as load_yml_string with the contents of the file at path, except
+ *  that the file is remembered (along with its mtime and size), so that
+ *  reload_changed! can tell when it needs re-parsing. If locale is given,
+ *  only that locale's translations are kept.
+ */
+
+static VALUE
+load_yml_file(int argc, VALUE *argv, VALUE self)
+{
+  i_translations_t *store = writable_store(self);
+  i_parse_t parse = {.arena = NULL, .translation_count = 0, .raise = 1, .failed = 0, .pool = store->pool.enabled ? &store->pool : NULL};
+  i_object_t *root;
+  i_source_t *source;
+  struct stat st;
+  long len;
+  char *yml;
+  VALUE path, locale, contents;
+
+  rb_scan_args(argc, argv, "11", &path, &locale);
+  FilePathValue(path);
+  if (!NIL_P(locale))
+    StringValueCStr(locale);
+  yml = read_file(RSTRING_PTR(path), &len, &st);
+  if (yml == NULL)
+    rb_sys_fail(RSTRING_PTR(path));
+  // copied into a ruby string so it gets freed even if parsing raises
+  contents = rb_str_new(yml, len);
+  free(yml);
+
+  parse.arena = new_arena(len);
+  root = parse_yml(&parse, RSTRING_PTR(contents), len);
+  if (root == NULL) {
+    delete_arena(parse.arena);
+    rb_raise(I18nemaBackendLoadError, "root yml node is not a hash");
+  }
+  if (!NIL_P(locale))
+    root = keep_only_locale(&parse, root, RSTRING_PTR(locale));
+  source = new_source(RSTRING_PTR(path), NULL, 0, &st);
+  if (!NIL_P(locale)) {
+    source->locale = new_string(NULL, RSTRING_PTR(locale), RSTRING_LEN(locale));
+  }
+  merge_translations(store, parse.arena, root, source);
+  RB_GC_GUARD(contents);
+  return INT2NUM(parse.translation_count);
+}
+
+static void
+parse_load_job(i_load_job_t *job)
+{
+  long len;
+  char *yml = read_file(job->path, &len, &job->st);
+  if (yml == NULL)
+    return; // load_yml will raise the appropriate Errno
+
+  job->parse.arena = new_arena(len);
+  job->root = read_yml(&job->parse, yml, len); // never syck, see i_load_batch_t
+  free(yml);
+  if (job->root == NULL) {
+    delete_arena(job->parse.arena);
+    job->parse.arena = NULL;
+  }
+}
+
+/*
+ * Runs without the GVL. read_yml's allocations go through ruby_xmalloc,
+ * which is fine without it (GC takes the GVL first)
+ */
+static void*
+run_load_worker(void *arg)
+{
+  i_load_worker_t *worker = (i_load_worker_t *)arg;
+  i_load_batch_t *batch = worker->batch;
+  for (long i = worker->index; i < batch->num_jobs && !batch->cancelled; i += batch->num_workers)
+    parse_load_job(&batch->jobs[i]);
+  return NULL;
+}
+
+#ifdef HAVE_RUBY_THREAD_H
+static void
+cancel_load_batch(void *arg)
+{
+  ((i_load_batch_t *)arg)->cancelled = 1;
+}
+
+static VALUE
+load_worker_thread(void *arg)
+{
+  i_load_worker_t *worker = (i_load_worker_t *)arg;
+  rb_thread_call_without_gvl(run_load_worker, worker, cancel_load_batch, worker->batch);
+  return Qnil;
+}
+#endif
+
+static VALUE
+run_load_batch(VALUE arg)
+{
+  i_load_batch_t *batch = (i_load_batch_t *)arg;
+  i_translations_t *store = translation_store_get(batch->self);
+  int count = 0;
+
+#ifdef HAVE_RUBY_THREAD_H
+  for (long i = 1; i < batch->num_workers; i++)
+    rb_ary_push(batch->threads, rb_thread_create(load_worker_thread, &batch->workers[i]));
+  rb_thread_call_without_gvl(run_load_worker, &batch->workers[0], cancel_load_batch, batch);
+  for (long i = 0; i < RARRAY_LEN(batch->threads); i++)
+    rb_funcall(RARRAY_PTR(batch->threads)[i], s_join, 0);
+  rb_thread_check_ints();
+#else
+  run_load_worker(&batch->workers[0]);
+#endif
+
+  for (long i = 0; i < batch->num_jobs; i++) {
+    i_load_job_t *job = &batch->jobs[i];
+    if (job->root == NULL) {
+      // needs syck (or has an error to raise), so it's done the usual way
+      if (job->parse.arena != NULL)
+        delete_arena(job->parse.arena);
+      job->parse.arena = NULL;
+      count += NUM2INT(rb_funcall(batch->self, s_load_yml, 1, RARRAY_PTR(batch->paths)[i]));
+    } else {
+      merge_translations(store, job->parse.arena, job->root, new_source(job->path, NULL, 0, &job->st));
+      job->parse.arena = NULL;
+      count += job->parse.translation_count;
+    }
+  }
+  return INT2NUM(count);
+}
+
+static VALUE
+join_load_thread(VALUE thread)
+{
+  return rb_funcall(thread, s_join, 0);
+}
+
+static VALUE
+finish_load_batch(VALUE arg)
+{
+  i_load_batch_t *batch = (i_load_batch_t *)arg;
+  int state;
+
+  // workers may still be going if we got interrupted
+  batch->cancelled = 1;
+  for (long i = 0; i < RARRAY_LEN(batch->threads); i++) {
+    VALUE thread = RARRAY_PTR(batch->threads)[i];
+    while (RTEST(rb_funcall(thread, s_alive_p, 0)))
+      rb_protect(join_load_thread, thread, &state);
+  }
+  for (long i = 0; i < batch->num_jobs; i++) {
+    xfree(batch->jobs[i].path);
+    if (batch->jobs[i].parse.arena != NULL)
+      delete_arena(batch->jobs[i].parse.arena);
+  }
+  xfree(batch->jobs);
+  xfree(batch->workers);
+  return Qnil;
+}
+
+/*
+ *  call-seq:
+ *     backend.parallel_load_yml_files(paths, threads) -> num_translations
+ *
+ *  Loads the yml files at paths, same as calling load_yml on each of them
+ *  in turn, except that they are read and parsed on up to threads native
+ *  threads without the GVL. The resulting trees are merged in order.
+ */
+
+static VALUE
+parallel_load_yml_files(VALUE self, VALUE paths, VALUE threads)
+{
+  i_load_batch_t batch;
+
+  i_translations_t *store = writable_store(self);
+  Check_Type(paths, T_ARRAY);
+  paths = rb_ary_dup(paths);
+  for (long i = 0; i < RARRAY_LEN(paths); i++) {
+    Check_Type(RARRAY_PTR(paths)[i], T_STRING);
+    StringValueCStr(RARRAY_PTR(paths)[i]);
+  }
+
+  batch.self = self;
+  batch.paths = paths;
+  batch.threads = rb_ary_new();
+  batch.num_jobs = RARRAY_LEN(paths);
+  batch.num_workers = NUM2LONG(threads);
+  if (batch.num_workers > batch.num_jobs)
+    batch.num_workers = batch.num_jobs;
+  if (batch.num_workers < 1)
+    batch.num_workers = 1;
+#ifndef HAVE_RUBY_THREAD_H
+  batch.num_workers = 1;
+#endif
+  batch.cancelled = 0;
+  batch.jobs = ALLOC_N(i_load_job_t, batch.num_jobs);
+  memset(batch.jobs, 0, sizeof(i_load_job_t) * batch.num_jobs);
+  for (long i = 0; i < batch.num_jobs; i++) {
+    VALUE path = RARRAY_PTR(paths)[i];
+    batch.jobs[i].path = new_string(NULL, RSTRING_PTR(path), RSTRING_LEN(path));
+#if defined(HAVE_RUBY_THREAD_NATIVE_H) || !defined(HAVE_RUBY_THREAD_H)
+    batch.jobs[i].parse.pool = store->pool.enabled ? &store->pool : NULL;
+#endif
+  }
+  batch.workers = ALLOC_N(i_load_worker_t, batch.num_workers);
+  for (long i = 0; i < batch.num_workers; i++) {
+    batch.workers[i].batch = &batch;
+    batch.workers[i].index = i;
+  }
+
+  VALUE result = rb_ensure(run_load_batch, (VALUE)&batch, finish_load_batch, (VALUE)&batch);
+  RB_GC_GUARD(paths);
+  RB_GC_GUARD(batch.threads);
+  return result;
+}
+
+static void
+delete_snapshot(i_snapshot_t *snapshot)
+{
+#ifdef HAVE_SYS_MMAN_H
+  if (snapshot->mapped)
+    munmap(snapshot->data, snapshot->size);
+  else
+#endif
+    xfree(snapshot->data);
+  xfree(snapshot);
+}
+
+static void
+clear_translations(i_translations_t *store)
+{
+  delete_arenas(store->arenas);
+  store->arenas = NULL;
+  if (store->snapshot != NULL)
+    delete_snapshot(store->snapshot);
+  store->snapshot = NULL;
+  store->root.type = i_type_hash;
+  store->root.data.hash = NULL;
+  clear_path_index(&store->index);
+  clear_string_cache(&store->string_cache, 0);
+  clear_cold_locales(store);
+  store->cold_spine = NULL;
+  for (i_source_t *source = store->sources, *next; source != NULL; source = next) {
+    next = source->next;
+    delete_source(source);
+  }
+  store->sources = NULL;
+  store->last_source = &store->sources;
+  store->spine = NULL;
+  store->incremental = 1;
+  translations_changed(store);
+}
+
+static i_object_t*
+thaw_snapshot_node(i_arena_t *arena, const i_snapshot_node_t *node, i_object_t *target);
+
+static i_object_t*
+thaw_snapshot_hash(i_arena_t *arena, const i_snapshot_node_t *node, i_object_t *target)
+{
+  const i_snapshot_child_t *children = (i_snapshot_child_t *)SNAPSHOT_AT(node, node->offset);
+  target->type = i_type_hash;
+  target->data.hash = NULL;
+  for (unsigned long i = 0; i < node->size; i++) {
+    const i_snapshot_child_t *child = &children[i];
+    char *key = new_string(arena, SNAPSHOT_AT(child, child->key), child->key_size);
+    i_object_t *value = thaw_snapshot_node(arena, (i_snapshot_node_t *)SNAPSHOT_AT(child, child->node), NULL);
+    i_key_value_t *kv = new_key_value(arena, key, value);
+    HASH_ADD_KEYPTR(hh, target->data.hash, kv->key, child->key_size, kv);
+  }
+  return target;
+}
+
+/*
+ * Copies a snapshot node into the arena. If target is NULL, a new object
+ * is allocated (except for true/false/null, which are shared). Works on
+ * any snapshot buffer, not just the store's own.
+ */
+static i_object_t*
+thaw_snapshot_node(i_arena_t *arena, const i_snapshot_node_t *node, i_object_t *target)
+{
+  char *data = SNAPSHOT_AT(node, node->offset);
+  if (target == NULL) {
+    switch (node->type) {
+    case i_type_true:
+      return &i_object_true;
+    case i_type_false:
+      return &i_object_false;
+    case i_type_null:
+      return &i_object_null;
+    default:
+      target = new_object(arena);
+    }
+  }
+  target->size = node->size;
+  target->rstring_slot = 0;
+  target->templated = 0;
+  switch (node->type) {
+  case i_type_array:
+    target->type = i_type_array;
+    target->data.array = i_alloc(arena, sizeof(i_object_t) * node->size);
+    for (unsigned long i = 0; i < node->size; i++)
+      thaw_snapshot_node(arena, (i_snapshot_node_t *)data + i, &target->data.array[i]);
+    break;
+  case i_type_hash:
+    thaw_snapshot_hash(arena, node, target);
+    break;
+  case i_type_true:
+  case i_type_false:
+  case i_type_null:
+    target->type = node->type;
+    break;
+  case i_type_string:
+    set_translation_string_object(arena, target, data, node->size);
+    break;
+  case i_type_symbol:
+    set_symbol_object(arena, target, data, node->size);
+    break;
+  default:
+    target->type = node->type;
+    target->data.string = new_string(arena, data, node->size);
+    break;
+  }
+  return target;
+}
+
+typedef struct i_thaw
+{
+  i_arena_t *arena;
+  const i_snapshot_node_t *node;
+  i_object_t *target;
+} i_thaw_t;
+
+static VALUE
+run_thaw(VALUE arg)
+{
+  i_thaw_t *thaw = (i_thaw_t *)arg;
+  uthash_arena = thaw->arena;
+  thaw->target = thaw_snapshot_node(thaw->arena, thaw->node, thaw->target);
+  return Qnil;
+}
+
+static VALUE
+restore_uthash_arena(VALUE previous)
+{
+  uthash_arena = (i_arena_t *)previous;
+  return Qnil;
+}
+
+/*
+ * thaw_snapshot_node, with uthash_arena pointed at arena for the hashes
+ * and put back afterwards, even if it raises
+ */
+static i_object_t*
+thaw_snapshot_into(i_arena_t *arena, const i_snapshot_node_t *node, i_object_t *target)
+{
+  i_thaw_t thaw = {arena, node, target};
+  rb_ensure(run_thaw, (VALUE)&thaw, restore_uthash_arena, (VALUE)uthash_arena);
+  return thaw.target;
+}
+
+/*
+ * Thaws a snapshot buffer other than the store's own (e.g. a compressed
+ * locale) into arena, returning its root
+ */
+static i_object_t*
+thaw_snapshot_data(i_arena_t *arena, char *data)
+{
+  return thaw_snapshot_into(arena, (i_snapshot_node_t *)(data + ((i_snapshot_header_t *)data)->nodes_offset), NULL);
+}
+
+/*
+ * Turns a snapshot-backed store back into a regular arena-backed tree,
+ * so that more translations can be merged into it
+ */
+static void
+thaw_snapshot(i_translations_t *store)
+{
+  i_snapshot_t *snapshot = store->snapshot;
+  i_arena_t *arena = new_arena(snapshot->size);
+  i_object_t root;
+
+  thaw_snapshot_into(arena, snapshot->nodes, &root);
+
+  clear_translations(store);
+  store->root = root;
+  store->arenas = arena;
+  add_source(store, new_source(NULL, NULL, 0, NULL), arena, &store->root);
+}
+
+static uint64_t
+snapshot_checksum(const char *data, size_t size)
+{
+  uint64_t hash = I_FNV_OFFSET, word;
+  size_t i = 0;
+  for (; i + sizeof(word) <= size; i += sizeof(word)) {
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * I_FNV_PRIME;
+    hash ^= hash >> 32;
+  }
+  for (; i < size; i++)
+    hash = (hash ^ (unsigned char)data[i]) * I_FNV_PRIME;
+  return hash;
+}
+
+typedef struct i_snapshot_writer
+{
+  i_snapshot_node_t *nodes;
+  unsigned long next_node;
+  i_snapshot_child_t *children;
+  unsigned long next_child;
+  char *strings;
+  size_t strings_size;
+  st_table *string_offsets;
+} i_snapshot_writer_t;
+
+typedef struct i_snapshot_sort_entry
+{
+  uint32_t hash;
+  uint32_t index;
+} i_snapshot_sort_entry_t;
+
+static void
+count_snapshot_object(i_object_t *object, unsigned long *nodes, unsigned long *children, size_t *string_bytes)
+{
+  (*nodes)++;
+  switch (object->type) {
+  case i_type_array:
+    for (unsigned long i = 0; i < object->size; i++)
+      count_snapshot_object(&object->data.array[i], nodes, children, string_bytes);
+    break;
+  case i_type_hash:
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next) {
+      (*children)++;
+      *string_bytes += strlen(kv->key) + 1;
+      count_snapshot_object(kv->value, nodes, children, string_bytes);
+    }
+    break;
+  case i_type_true:
+  case i_type_false:
+  case i_type_null:
+    break;
+  default:
+    *string_bytes += object->size + 1;
+    break;
+  }
+}
+
+static char*
+snapshot_string(i_snapshot_writer_t *writer, const char *str, unsigned long len)
+{
+  st_data_t offset;
+  // embedded NULs would confuse the strtable, so those just don't get deduped
+  int dedupe = strlen(str) == len;
+  if (dedupe && st_lookup(writer->string_offsets, (st_data_t)str, &offset))
+    return writer->strings + offset;
+
+  char *result = writer->strings + writer->strings_size;
+  memcpy(result, str, len);
+  result[len] = '\0';
+  if (dedupe)
+    st_insert(writer->string_offsets, (st_data_t)str, (st_data_t)writer->strings_size);
+  writer->strings_size += len + 1;
+  return result;
+}
+
+static int
+compare_snapshot_sort_entries(const void *a, const void *b)
+{
+  const i_snapshot_sort_entry_t *x = a, *y = b;
+  if (x->hash != y->hash)
+    return x->hash < y->hash ? -1 : 1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static void
+write_snapshot_object(i_snapshot_writer_t *writer, i_object_t *object, i_snapshot_node_t *node)
+{
+  node->type = object->type;
+  node->size = object->size;
+  node->offset = 0;
+  switch (object->type) {
+  case i_type_array: {
+    i_snapshot_node_t *items = writer->nodes + writer->next_node;
+    writer->next_node += object->size;
+    node->offset = (char *)items - (char *)node;
+    for (unsigned long i = 0; i < object->size; i++)
+      write_snapshot_object(writer, &object->data.array[i], &items[i]);
+    break;
+  }
+  case i_type_hash: {
+    unsigned long count = HASH_COUNT(object->data.hash), i = 0;
+    i_snapshot_child_t *children = writer->children + writer->next_child;
+    i_snapshot_sort_entry_t *sorted = ALLOC_N(i_snapshot_sort_entry_t, count);
+    writer->next_child += count;
+    node->size = count;
+    node->offset = (char *)children - (char *)node;
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next, i++) {
+      i_snapshot_child_t *child = &children[i];
+      i_snapshot_node_t *child_node = writer->nodes + writer->next_node++;
+      unsigned long key_size = strlen(kv->key);
+      child->hash = snapshot_key_hash(kv->key, key_size);
+      child->key_size = key_size;
+      child->unused = 0;
+      child->key = snapshot_string(writer, kv->key, key_size) - (char *)child;
+      child->node = (char *)child_node - (char *)child;
+      sorted[i].hash = child->hash;
+      sorted[i].index = i;
+      write_snapshot_object(writer, kv->value, child_node);
+    }
+    qsort(sorted, count, sizeof(i_snapshot_sort_entry_t), compare_snapshot_sort_entries);
+    for (i = 0; i < count; i++)
+      children[i].sorted = sorted[i].index;
+    xfree(sorted);
+    break;
+  }
+  case i_type_true:
+  case i_type_false:
+  case i_type_null:
+    break;
+  default:
+    node->offset = snapshot_string(writer, object->data.string, object->size) - (char *)node;
+    break;
+  }
+}
+
+/*
+ * Serializes root (and everything under it) into a new snapshot buffer;
+ * its size is in the header's file_size
+ */
+static char*
+build_snapshot(i_object_t *root, const char *fingerprint, size_t fingerprint_size)
+{
+  unsigned long node_count = 0, child_count = 0;
+  size_t string_bytes = 0;
+
+  count_snapshot_object(root, &node_count, &child_count, &string_bytes);
+
+  size_t nodes_offset = (sizeof(i_snapshot_header_t) + fingerprint_size + 7) & ~(size_t)7,
+         children_offset = nodes_offset + sizeof(i_snapshot_node_t) * node_count,
+         strings_offset = children_offset + sizeof(i_snapshot_child_t) * child_count;
+  char *data = ALLOC_N(char, strings_offset + string_bytes);
+  memset(data, 0, strings_offset);
+
+  i_snapshot_writer_t writer;
+  writer.nodes = (i_snapshot_node_t *)(data + nodes_offset);
+  writer.next_node = 1;
+  writer.children = (i_snapshot_child_t *)(data + children_offset);
+  writer.next_child = 0;
+  writer.strings = data + strings_offset;
+  writer.strings_size = 0;
+  writer.string_offsets = st_init_strtable();
+  write_snapshot_object(&writer, root, writer.nodes);
+  st_free_table(writer.string_offsets);
+
+  i_snapshot_header_t *header = (i_snapshot_header_t *)data;
+  memcpy(header->magic, I_SNAPSHOT_MAGIC, sizeof(I_SNAPSHOT_MAGIC));
+  header->version = I_SNAPSHOT_VERSION;
+  header->endian = I_SNAPSHOT_ENDIAN;
+  header->file_size = strings_offset + writer.strings_size;
+  header->fingerprint_size = fingerprint_size;
+  header->node_count = node_count;
+  header->child_count = child_count;
+  header->nodes_offset = nodes_offset;
+  header->children_offset = children_offset;
+  header->strings_offset = strings_offset;
+  memcpy(data + sizeof(i_snapshot_header_t), fingerprint, fingerprint_size);
+  header->checksum = snapshot_checksum(data + sizeof(i_snapshot_header_t), header->file_size - sizeof(i_snapshot_header_t));
+  return data;
+}
+
+/*
+ * Like build_snapshot, but for a snapshot-backed store: the nodes,
+ * children and strings only point at each other (relative to where they
+ * are), so they can be copied as they are behind a new header and
+ * fingerprint, without thawing anything
+ */
+static char*
+copy_snapshot(i_snapshot_t *snapshot, const char *fingerprint, size_t fingerprint_size)
+{
+  const i_snapshot_header_t *old_header = (i_snapshot_header_t *)snapshot->data;
+  size_t nodes_offset = (sizeof(i_snapshot_header_t) + fingerprint_size + 7) & ~(size_t)7,
+         body_size = old_header->file_size - old_header->nodes_offset;
+  char *data = ALLOC_N(char, nodes_offset + body_size);
+  memset(data, 0, nodes_offset);
+  memcpy(data + nodes_offset, snapshot->data + old_header->nodes_offset, body_size);
+
+  i_snapshot_header_t *header = (i_snapshot_header_t *)data;
+  *header = *old_header;
+  header->file_size = nodes_offset + body_size;
+  header->fingerprint_size = fingerprint_size;
+  header->nodes_offset = nodes_offset;
+  header->children_offset = nodes_offset + (old_header->children_offset - old_header->nodes_offset);
+  header->strings_offset = nodes_offset + (old_header->strings_offset - old_header->nodes_offset);
+  memcpy(data + sizeof(i_snapshot_header_t), fingerprint, fingerprint_size);
+  header->checksum = snapshot_checksum(data + sizeof(i_snapshot_header_t), header->file_size - sizeof(i_snapshot_header_t));
+  return data;
+}
+
+/*
+ *  call-seq:
+ *     backend.write_snapshot(path, fingerprint) -> true
+ *
+ *  Writes all currently loaded translations to a binary snapshot at the
+ *  specified path. fingerprint is an opaque string identifying the
+ *  translation sources; read_snapshot will only accept the snapshot if
+ *  it is given the same fingerprint. Most callers want dump_snapshot.
+ *  A backend that was itself loaded from a snapshot keeps using it.
+ */
+
+static VALUE
+write_snapshot(VALUE self, VALUE path, VALUE fingerprint)
+{
+  i_translations_t *store = translation_store_get(self);
+  char *data;
+
+  StringValue(fingerprint);
+  FilePathValue(path);
+  if (store->snapshot != NULL) {
+    // leaves the store (and its shared pages) as it is
+    data = copy_snapshot(store->snapshot, RSTRING_PTR(fingerprint), RSTRING_LEN(fingerprint));
+  } else {
+    warm_cold_locales(store); // a no-op once frozen, since freeze! warms them all
+    data = build_snapshot(&store->root, RSTRING_PTR(fingerprint), RSTRING_LEN(fingerprint));
+  }
+  i_snapshot_header_t *header = (i_snapshot_header_t *)data;
+
+  // write to a temp file and rename, so readers never see a partial snapshot
+  VALUE tmp_path = rb_str_dup(path);
+  rb_str_catf(tmp_path, ".%d.tmp", (int)getpid());
+  FILE *file = fopen(RSTRING_PTR(tmp_path), "wb");
+  int failed = file == NULL ||
+               fwrite(data, 1, header->file_size, file) != header->file_size;
+  if (file != NULL && fclose(file) != 0)
+    failed = 1;
+  xfree(data);
+  if (failed || rename(RSTRING_PTR(tmp_path), RSTRING_PTR(path)) != 0) {
+    int error = errno;
+    unlink(RSTRING_PTR(tmp_path));
+    errno = error;
+    rb_sys_fail(RSTRING_PTR(path));
+  }
+  return Qtrue;
+}
+
+/*
+ * Whether the len bytes at str (plus a NUL) lie within the strings
+ */
+static int
+snapshot_string_ok(const i_snapshot_header_t *header, const char *str, uint64_t len)
+{
+  const char *strings = (const char *)header + header->strings_offset,
+             *end = (const char *)header + header->file_size;
+  return str >= strings && str < end && len < (uint64_t)(end - str) && str[len] == '\0';
+}
+
+/*
+ * Index of the node at base + offset, or -1 if there isn't one there
+ */
+static int64_t
+snapshot_node_index(const i_snapshot_header_t *header, const void *base, int64_t offset)
+{
+  const char *nodes = (const char *)header + header->nodes_offset,
+             *node = (const char *)base + offset;
+  if (node < nodes || (uint64_t)(node - nodes) % sizeof(i_snapshot_node_t) != 0 ||
+      (uint64_t)(node - nodes) / sizeof(i_snapshot_node_t) >= header->node_count)
+    return -1;
+  return (node - nodes) / sizeof(i_snapshot_node_t);
+}
+
+/*
+ * Makes sure every offset in the snapshot points where it should, so a
+ * corrupt file can't send lookups off the end of the mapping. Items and
+ * children always come after their parent, which rules out cycles.
+ */
+static const char*
+check_snapshot_layout(i_snapshot_t *snapshot)
+{
+  const i_snapshot_header_t *header = (i_snapshot_header_t *)snapshot->data;
+  const i_snapshot_child_t *all_children;
+
+  if (header->nodes_offset < sizeof(i_snapshot_header_t) + header->fingerprint_size || header->nodes_offset % 8 != 0 ||
+      header->children_offset < header->nodes_offset || header->strings_offset < header->children_offset ||
+      header->strings_offset > header->file_size || header->node_count == 0 ||
+      header->node_count > (header->children_offset - header->nodes_offset) / sizeof(i_snapshot_node_t) ||
+      header->child_count > (header->strings_offset - header->children_offset) / sizeof(i_snapshot_child_t))
+    return "snapshot is truncated";
+  all_children = (i_snapshot_child_t *)(snapshot->data + header->children_offset);
+
+  for (uint64_t i = 0; i < header->node_count; i++) {
+    const i_snapshot_node_t *node = snapshot->nodes + i;
+    switch (node->type) {
+    case i_type_array: {
+      int64_t first = snapshot_node_index(header, node, node->offset);
+      if (node->size > 0 && (first <= (int64_t)i || node->size > header->node_count - first))
+        return "snapshot has a bad array";
+      break;
+    }
+    case i_type_hash: {
+      const i_snapshot_child_t *children = (i_snapshot_child_t *)SNAPSHOT_AT(node, node->offset);
+      if (node->size == 0)
+        break;
+      if (children < all_children || (uint64_t)((char *)children - (char *)all_children) % sizeof(i_snapshot_child_t) != 0 ||
+          node->size > header->child_count - (children - all_children))
+        return "snapshot has a bad hash";
+      for (uint32_t j = 0; j < node->size; j++) {
+        const i_snapshot_child_t *child = &children[j];
+        if (child->sorted >= node->size || snapshot_node_index(header, child, child->node) <= (int64_t)i ||
+            !snapshot_string_ok(header, SNAPSHOT_AT(child, child->key), child->key_size))
+          return "snapshot has a bad hash";
+      }
+      break;
+    }
+    case i_type_true:
+    case i_type_false:
+    case i_type_null:
+      break;
+    case i_type_string:
+    case i_type_int:
+    case i_type_float:
+    case i_type_symbol:
+      if (!snapshot_string_ok(header, SNAPSHOT_AT(node, node->offset), node->size))
+        return "snapshot has a bad string";
+      break;
+    default:
+      return "snapshot has a bad node";
+    }
+  }
+  return NULL;
+}
+
+static void
+snapshot_error(i_snapshot_t *snapshot, const char *message)
+{
+  delete_snapshot(snapshot);
+  rb_raise(I18nemaBackendLoadError, "%s", message);
+}
+
+/*
+ *  call-seq:
+ *     backend.read_snapshot(path, fingerprint) -> bool
+ *
+ *  Replaces all translations with those in the snapshot at the specified
+ *  path. The snapshot is memory-mapped and used in place, so its pages
+ *  are shared by every process using it. Returns false (and leaves
+ *  things alone) if the snapshot is stale, i.e. it has a different
+ *  fingerprint or was written by a different version of I18nema. Raises
+ *  a LoadError if the snapshot is corrupt. Most callers want
+ *  load_snapshot.
+ */
+
+static VALUE
+read_snapshot(VALUE self, VALUE path, VALUE fingerprint)
+{
+  i_translations_t *store = writable_store(self);
+  struct stat st;
+  int fd;
+
+  StringValue(fingerprint);
+  FilePathValue(path);
+  fd = open(RSTRING_PTR(path), O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0)
+      close(fd);
+    rb_sys_fail(RSTRING_PTR(path));
+  }
+
+  i_snapshot_t *snapshot = ALLOC(i_snapshot_t);
+  snapshot->size = st.st_size;
+  snapshot->mapped = 0;
+  snapshot->data = NULL;
+#ifdef HAVE_SYS_MMAN_H
+  if (snapshot->size > 0) {
+    void *data = mmap(NULL, snapshot->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED) {
+      snapshot->data = data;
+      snapshot->mapped = 1;
+    }
+  }
+#endif
+  if (!snapshot->mapped) {
+    snapshot->data = ALLOC_N(char, snapshot->size);
+    if (read(fd, snapshot->data, snapshot->size) != (ssize_t)snapshot->size) {
+      close(fd);
+      snapshot_error(snapshot, "unable to read snapshot");
+    }
+  }
+  close(fd);
+
+  const i_snapshot_header_t *header = (i_snapshot_header_t *)snapshot->data;
+  const char *error;
+  if (snapshot->size < sizeof(i_snapshot_header_t) || memcmp(header->magic, I_SNAPSHOT_MAGIC, sizeof(I_SNAPSHOT_MAGIC)) != 0)
+    snapshot_error(snapshot, "not an i18nema snapshot");
+  if (header->version != I_SNAPSHOT_VERSION || header->endian != I_SNAPSHOT_ENDIAN ||
+      header->fingerprint_size != (uint64_t)RSTRING_LEN(fingerprint) ||
+      snapshot->size - sizeof(i_snapshot_header_t) < header->fingerprint_size ||
+      memcmp(snapshot->data + sizeof(i_snapshot_header_t), RSTRING_PTR(fingerprint), RSTRING_LEN(fingerprint)) != 0) {
+    delete_snapshot(snapshot);
+    return Qfalse;
+  }
+  if (header->file_size != snapshot->size)
+    snapshot_error(snapshot, "snapshot is truncated");
+  if (header->checksum != snapshot_checksum(snapshot->data + sizeof(i_snapshot_header_t), snapshot->size - sizeof(i_snapshot_header_t)))
+    snapshot_error(snapshot, "snapshot checksum mismatch");
+  snapshot->nodes = (i_snapshot_node_t *)(snapshot->data + header->nodes_offset);
+  if ((error = check_snapshot_layout(snapshot)) != NULL)
+    snapshot_error(snapshot, error);
+  if (snapshot->nodes->type != i_type_hash)
+    snapshot_error(snapshot, "snapshot root is not a hash");
+
+  clear_translations(store);
+  clear_string_pool(&store->pool);
+  store->snapshot = snapshot;
+  store->root.type = i_type_snapshot_hash;
+  store->root.size = snapshot->nodes->size;
+  store->root.data.snapshot = snapshot->nodes;
+  return Qtrue;
+}
+
+/*
+ *  call-seq:
+ *     backend.available_locales -> locales
+ *
+ *  Returns the currently loaded locales (including, with lazy_locales,
+ *  those that will be loaded on first use, and compressed ones). Order
+ *  is not guaranteed.
+ *
+ *     backend.available_locales   #=> [:en, :es]
+ */
+
+static VALUE
+available_locales(VALUE self)
+{
+  if (!RTEST(rb_iv_get(self, "@initialized")))
+    rb_funcall(self, s_init_translations, 0);
+  i_translations_t *store = translation_store_get(self);
+  VALUE ary = rb_ary_new2(0);
+
+  if (store->snapshot != NULL) {
+    const i_snapshot_node_t *root = store->snapshot->nodes;
+    const i_snapshot_child_t *children = (i_snapshot_child_t *)SNAPSHOT_AT(root, root->offset);
+    for (unsigned long i = 0; i < root->size; i++)
+      rb_ary_push(ary, rb_str_intern(rb_str_new2(SNAPSHOT_AT(&children[i], children[i].key))));
+    return ary;
+  }
+
+  i_key_value_t *current = store->root.data.hash;
+  for (; current != NULL; current = current->hh.next)
+    rb_ary_push(ary, rb_str_intern(rb_str_new2(current->key)));
+  for (i_cold_locale_t *cold = store->cold_locales; cold != NULL; cold = cold->hh.next)
+    if (cold->blob != NULL)
+      rb_ary_push(ary, rb_str_intern(rb_str_new2(cold->locale)));
+
+  VALUE pending = rb_ivar_get(self, s_pending_locales);
+  if (!NIL_P(pending)) {
+    VALUE locales = rb_funcall(pending, rb_intern("keys"), 0);
+    for (long i = 0; i < RARRAY_LEN(locales); i++) {
+      VALUE locale = rb_str_intern(RARRAY_PTR(locales)[i]);
+      if (!RTEST(rb_ary_includes(ary, locale)))
+        rb_ary_push(ary, locale);
+    }
+  }
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *     backend.reload! -> true
+ *
+ *  Clears out all currently stored translations.
+ *
+ *     backend.reload!   #=> true
+ */
+
+static VALUE
+reload(VALUE self)
+{
+  i_translations_t *store = writable_store(self);
+  clear_translations(store);
+  clear_string_pool(&store->pool);
+  rb_iv_set(self, "@initialized", Qfalse);
+  rb_ivar_set(self, s_pending_locales, Qnil);
+  return Qtrue;
+}
+
+static int
+source_changed(i_source_t *source)
+{
+  struct stat st;
+  if (source->path == NULL)
+    return 0;
+  return stat(source->path, &st) != 0 || st.st_mtime != source->mtime ||
+         stat_mtime_nsec(&st) != source->mtime_nsec || st.st_size != source->size;
+}
+
+static int
+is_subtree(const char *id)
+{
+  return strchr(id, (char)I_PATH_SEPARATOR) != NULL;
+}
+
+static void
+add_subtrees(i_subtree_t **affected, const char *id, unsigned long num_subtrees)
+{
+  i_subtree_t *subtree;
+  for (unsigned long i = 0; i < num_subtrees; i++, id += strlen(id) + 1) {
+    if (!is_subtree(id))
+      continue;
+    HASH_FIND_STR(*affected, id, subtree);
+    if (subtree == NULL) {
+      subtree = ALLOC(i_subtree_t);
+      subtree->id = id;
+      HASH_ADD_KEYPTR(hh, *affected, subtree->id, strlen(subtree->id), subtree);
+    }
+  }
+}
+
+static int
+source_affected(i_source_t *source, i_subtree_t *affected)
+{
+  i_subtree_t *subtree;
+  const char *id = source->subtrees;
+  for (unsigned long i = 0; i < source->num_subtrees; i++, id += strlen(id) + 1) {
+    HASH_FIND_STR(affected, id, subtree);
+    if (subtree != NULL)
+      return 1;
+  }
+  return 0;
+}
+
+/*
+ * Parses the current contents of source into new_arena/new_root, without
+ * raising. Returns 0 if the result can't be merged incrementally (see
+ * source_subtrees).
+ */
+static int
+reparse_source(i_translations_t *store, i_source_t *source, i_string_pool_t *pool)
+{
+  i_parse_t parse = {.arena = NULL, .translation_count = 0, .raise = 0, .failed = 0, .pool = pool};
+  char *yml = source->yml;
+  long len = source->yml_len;
+
+  source->state = i_source_failed;
+  if (source->tree != NULL) {
+    // nothing to parse, it just needs a fresh copy
+    parse.arena = new_arena(((i_snapshot_header_t *)source->tree)->file_size);
+    string_pool = pool;
+    source->new_root = thaw_snapshot_data(parse.arena, source->tree);
+    string_pool = NULL;
+  } else {
+    if (source->path != NULL) {
+      yml = read_file(source->path, &len, &source->new_st);
+      if (yml == NULL) {
+        if (errno == ENOENT)
+          source->state = i_source_removed;
+        return 1;
+      }
+    }
+    parse.arena = new_arena(len);
+    source->new_root = parse_yml(&parse, yml, len);
+    if (source->path != NULL)
+      free(yml);
+  }
+  if (source->new_root == NULL) {
+    delete_arena(parse.arena);
+    return 1;
+  }
+  if (source->locale != NULL)
+    source->new_root = keep_only_locale(&parse, source->new_root, source->locale);
+  if (!source_subtrees(parse.arena, source->new_root, &source->new_subtrees, &source->num_new_subtrees)) {
+    delete_arena(parse.arena);
+    source->new_root = NULL;
+    source->state = i_source_unchanged;
+    return 0;
+  }
+  parse.arena->recycled = NULL;
+  source->new_arena = parse.arena;
+  source->state = i_source_reparsed;
+  return 1;
+}
+
+/*
+ * Parses source again, this time raising whatever error made it fail
+ */
+static void
+raise_source_error(i_source_t *source)
+{
+  i_parse_t parse = {.arena = NULL, .translation_count = 0, .raise = 1, .failed = 0, .pool = NULL};
+  struct stat st;
+  long len;
+  VALUE contents;
+
+  if (source->path != NULL) {
+    char *yml = read_file(source->path, &len, &st);
+    if (yml == NULL)
+      rb_sys_fail(source->path);
+    contents = rb_str_new(yml, len);
+    free(yml);
+  } else {
+    contents = rb_str_new(source->yml, source->yml_len);
+  }
+  parse.arena = new_arena(RSTRING_LEN(contents));
+  i_object_t *root = parse_yml(&parse, RSTRING_PTR(contents), RSTRING_LEN(contents));
+  delete_arena(parse.arena);
+  RB_GC_GUARD(contents);
+  if (root == NULL)
+    rb_raise(I18nemaBackendLoadError, "root yml node is not a hash");
+  rb_raise(I18nemaBackendLoadError, "%s changed while reloading", source->path ? source->path : "translations");
+}
+
+static void
+remove_arena(i_translations_t *store, i_arena_t *arena)
+{
+  for (i_arena_t **current = &store->arenas; *current != NULL; current = &(*current)->next) {
+    if (*current == arena) {
+      *current = arena->next;
+      break;
+    }
+  }
+  delete_arena(arena);
+}
+
+static i_object_t*
+spine_locale(i_arena_t *spine, i_object_t *root, const char *key, unsigned long len)
+{
+  i_key_value_t *locale;
+  HASH_FIND(hh, root->data.hash, key, len, locale);
+  if (locale == NULL) {
+    locale = new_key_value(spine, new_string(spine, (char *)key, len), new_hash_object(spine));
+    HASH_ADD_KEYPTR(hh, root->data.hash, locale->key, len, locale);
+  }
+  return locale->value;
+}
+
+/*
+ * Swaps in a new root made of the unaffected subtrees of the current
+ * one, plus the affected ones merged from the re-parsed sources in order
+ */
+static void
+rebuild_translations(i_translations_t *store, i_subtree_t *affected)
+{
+  i_arena_t *spine = new_arena(0);
+  i_object_t root;
+  i_key_value_t *locale, *kv, *tmp, *existing;
+  i_subtree_t *subtree;
+  char *id = NULL;
+  size_t id_size = 0;
+
+  root.type = i_type_hash;
+  root.data.hash = NULL;
+  uthash_arena = spine;
+  for (locale = store->root.data.hash; locale != NULL; locale = locale->hh.next) {
+    HASH_ITER(hh, locale->value->data.hash, kv, tmp) {
+      size_t size = locale->hh.keylen + kv->hh.keylen + 2;
+      if (size > id_size)
+        REALLOC_N(id, char, id_size = size * 2);
+      memcpy(id, locale->key, locale->hh.keylen);
+      id[locale->hh.keylen] = (char)I_PATH_SEPARATOR;
+      memcpy(id + locale->hh.keylen + 1, kv->key, kv->hh.keylen + 1);
+      HASH_FIND_STR(affected, id, subtree);
+      if (subtree == NULL) {
+        i_object_t *target = spine_locale(spine, &root, locale->key, locale->hh.keylen);
+        HASH_ADD_KEYPTR(hh, target->data.hash, kv->key, kv->hh.keylen, kv);
+      }
+    }
+  }
+  xfree(id);
+
+  for (i_source_t *source = store->sources; source != NULL; source = source->next) {
+    const char *locale_id = source->subtrees;
+    if (source->state == i_source_unchanged) {
+      // locales with nothing in them still count
+      for (unsigned long i = 0; i < source->num_subtrees; i++, locale_id += strlen(locale_id) + 1)
+        if (!is_subtree(locale_id))
+          spine_locale(spine, &root, locale_id, strlen(locale_id));
+      continue;
+    }
+    if (source->state != i_source_reparsed)
+      continue;
+    for (locale = source->new_root->data.hash; locale != NULL; locale = locale->hh.next) {
+      i_object_t *target = spine_locale(spine, &root, locale->key, locale->hh.keylen);
+      HASH_ITER(hh, locale->value->data.hash, kv, tmp) {
+        HASH_FIND(hh, target->data.hash, kv->key, kv->hh.keylen, existing);
+        if (existing != NULL && existing->value->type == i_type_hash && kv->value->type == i_type_hash) {
+          // below the locale level, tables go in the arena of the source
+          uthash_arena = source->new_arena;
+          merge_hash(existing->value, kv->value);
+          uthash_arena = spine;
+          continue;
+        }
+        if (existing != NULL)
+          HASH_DEL(target->data.hash, existing);
+        HASH_ADD_KEYPTR(hh, target->data.hash, kv->key, kv->hh.keylen, kv);
+      }
+    }
+  }
+  uthash_arena = NULL;
+
+  if (store->spine != NULL)
+    remove_arena(store, store->spine);
+  store->spine = spine;
+  spine->next = store->arenas;
+  store->arenas = spine;
+  store->root = root;
+  translations_changed(store);
+}
+
+static void
+finish_reload(i_translations_t *store)
+{
+  i_source_t **current = &store->sources;
+  store->last_source = &store->sources;
+  while (*current != NULL) {
+    i_source_t *source = *current;
+    if (source->state == i_source_reparsed || source->state == i_source_removed)
+      remove_arena(store, source->arena);
+    if (source->state == i_source_removed) {
+      *current = source->next;
+      delete_source(source);
+      continue;
+    }
+    if (source->state == i_source_reparsed) {
+      source->arena = source->new_arena;
+      source->arena->next = store->arenas;
+      store->arenas = source->arena;
+      source->subtrees = source->new_subtrees;
+      source->num_subtrees = source->num_new_subtrees;
+      if (source->path != NULL) {
+        source->mtime = source->new_st.st_mtime;
+        source->mtime_nsec = stat_mtime_nsec(&source->new_st);
+        source->size = source->new_st.st_size;
+      }
+    }
+    source->state = i_source_unchanged;
+    source->new_arena = NULL;
+    source->new_root = NULL;
+    current = &source->next;
+    store->last_source = current;
+  }
+}
+
+/*
+ *  call-seq:
+ *     backend.reload_changed_sources -> num_reloaded or nil
+ *
+ *  Re-parses the yml files whose mtime (to the nanosecond, where the
+ *  platform has them) or size has changed since they were loaded (or
+ *  drops them if they're gone), along with any other
+ *  sources that contribute to the same subtrees (locale and top level
+ *  key), and rebuilds just those subtrees; everything else stays as is.
+ *  Merging happens in the original load order, so the result is the same
+ *  as loading everything from scratch. Returns the number of sources
+ *  re-parsed, or nil if this isn't possible with what's loaded (e.g. a
+ *  snapshot), in which case you need to reload! instead.
+ */
+
+static VALUE
+reload_changed_sources(VALUE self)
+{
+  i_translations_t *store = writable_store(self);
+  i_subtree_t *affected = NULL, *subtree, *tmp;
+  i_source_t *source, *failed = NULL;
+  int changed = 0, incremental = store->incremental && store->snapshot == NULL, reparsed = 0;
+
+  if (!incremental)
+    return Qnil;
+  for (source = store->sources; source != NULL; source = source->next) {
+    source->state = source_changed(source) ? i_source_changed : i_source_unchanged;
+    changed |= source->state == i_source_changed;
+  }
+  if (!changed)
+    return INT2FIX(0);
+
+  // re-parse the changed sources, then any others sharing subtrees with
+  // them, and so on until there are no more
+  for (int progress = 1; progress && incremental && failed == NULL; ) {
+    progress = 0;
+    for (source = store->sources; source != NULL && incremental && failed == NULL; source = source->next) {
+      if (source->state != i_source_changed && (source->state != i_source_unchanged || !source_affected(source, affected)))
+        continue;
+      progress = 1;
+      if (!source->reparseable) {
+        incremental = 0;
+        break;
+      }
+      if (!reparse_source(store, source, store->pool.enabled ? &store->pool : NULL)) {
+        incremental = 0;
+        break;
+      }
+      reparsed++;
+      if (source->state == i_source_failed) {
+        failed = source;
+        break;
+      }
+      add_subtrees(&affected, source->subtrees, source->num_subtrees);
+      if (source->state == i_source_reparsed)
+        add_subtrees(&affected, source->new_subtrees, source->num_new_subtrees);
+    }
+  }
+
+  if (incremental && failed == NULL) {
+    // cached strings may belong to arenas that are about to go
+    clear_string_cache(&store->string_cache, 1);
+    rebuild_translations(store, affected);
+    finish_reload(store);
+  } else {
+    for (source = store->sources; source != NULL; source = source->next) {
+      if (source->new_arena != NULL)
+        delete_arena(source->new_arena);
+      source->new_arena = NULL;
+      source->new_root = NULL;
+      source->state = i_source_unchanged;
+    }
+  }
+  HASH_ITER(hh, affected, subtree, tmp) {
+    HASH_DEL(affected, subtree);
+    xfree(subtree);
+  }
+
+  if (failed != NULL)
+    raise_source_error(failed);
+  return incremental ? INT2NUM(reparsed) : Qnil;
+}
+
+/*
+ *  call-seq:
+ *     backend.source_paths -> paths
+ *
+ *  Returns the paths of the files that translations have been loaded
+ *  from (via load_yml_file or load_yml_files), in load order.
+ */
+
+static VALUE
+source_paths(VALUE self)
+{
+  i_translations_t *store = translation_store_get(self);
+  VALUE result = rb_ary_new();
+  for (i_source_t *source = store->sources; source != NULL; source = source->next)
+    if (source->path != NULL)
+      rb_ary_push(result, rb_str_new2(source->path));
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     backend.arena_usage -> hash
+ *
+ *  Returns how much memory the translation arenas are holding on to.
+ *  <tt>:bytes_allocated</tt> is what has been malloced for chunks,
+ *  <tt>:bytes_used</tt> is how much of that actually holds data.
+ *
+ *     backend.arena_usage   #=> {:arenas=>2, :chunks=>5, :bytes_allocated=>126976, :bytes_used=>121530}
+ */
+
+static VALUE
+arena_usage(VALUE self)
+{
+  i_translations_t *store = translation_store_get(self);
+  unsigned long arenas = 0, chunks = 0;
+  size_t allocated = 0, used = 0;
+  for (i_arena_t *arena = store->arenas; arena != NULL; arena = arena->next) {
+    arenas++;
+    chunks += arena->num_chunks;
+    allocated += arena->allocated;
+    used += arena->used;
+  }
+
+  VALUE result = rb_hash_new();
+  rb_hash_aset(result, ID2SYM(rb_intern("arenas")), ULONG2NUM(arenas));
+  rb_hash_aset(result, ID2SYM(rb_intern("chunks")), ULONG2NUM(chunks));
+  rb_hash_aset(result, ID2SYM(rb_intern("bytes_allocated")), SIZET2NUM(allocated));
+  rb_hash_aset(result, ID2SYM(rb_intern("bytes_used")), SIZET2NUM(used));
+  return result;
+}
+
+typedef struct i_node_stats
+{
+  unsigned long nodes[i_type_snapshot_hash + 1]; // snapshot views are counted as plain arrays/hashes
+  size_t string_bytes;
+  size_t key_bytes;
+  unsigned long depth; // deepest level seen
+} i_node_stats_t;
+
+typedef struct i_level_stats
+{
+  unsigned long hashes;
+  unsigned long keys;
+  unsigned long buckets; // snapshot hashes are sorted arrays, so they have none
+  unsigned long max_chain;
+} i_level_stats_t;
+
+static const char *i_object_type_names[] = {
+  NULL, "string", "array", "hash", "int", "float", "symbol", "true", "false", "null"
+};
+
+/*
+ * Tallies object and everything under it. levels (if given) gets the
+ * hash table stats for each depth; it must have room for stats->depth
+ * (as found by a previous pass)
+ */
+static void
+collect_stats(i_translations_t *store, i_object_t *object, unsigned long depth, i_node_stats_t *stats, i_level_stats_t *levels)
+{
+  i_object_t view;
+  enum i_object_type type = object->type;
+  if (type == i_type_snapshot_array)
+    type = i_type_array;
+  else if (type == i_type_snapshot_hash)
+    type = i_type_hash;
+  stats->nodes[type]++;
+  if (depth > stats->depth)
+    stats->depth = depth;
+
+  switch (object->type) {
+  case i_type_string:
+    stats->string_bytes += object->size;
+    break;
+  case i_type_array:
+    for (unsigned long i = 0; i < object->size; i++)
+      collect_stats(store, &object->data.array[i], depth + 1, stats, levels);
+    break;
+  case i_type_hash:
+    if (levels != NULL) {
+      levels[depth].hashes++;
+      levels[depth].keys += HASH_COUNT(object->data.hash);
+      if (object->data.hash != NULL) {
+        UT_hash_table *table = object->data.hash->hh.tbl;
+        levels[depth].buckets += table->num_buckets;
+        for (unsigned long i = 0; i < table->num_buckets; i++)
+          if (table->buckets[i].count > levels[depth].max_chain)
+            levels[depth].max_chain = table->buckets[i].count;
+      }
+    }
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next) {
+      stats->key_bytes += kv->hh.keylen;
+      collect_stats(store, kv->value, depth + 1, stats, levels);
+    }
+    break;
+  case i_type_snapshot_array: {
+    const i_snapshot_node_t *items = (i_snapshot_node_t *)SNAPSHOT_AT(object->data.snapshot, object->data.snapshot->offset);
+    for (unsigned long i = 0; i < object->size; i++)
+      collect_stats(store, snapshot_view(store, &items[i], &view), depth + 1, stats, levels);
+    break;
+  }
+  case i_type_snapshot_hash: {
+    const i_snapshot_child_t *children = (i_snapshot_child_t *)SNAPSHOT_AT(object->data.snapshot, object->data.snapshot->offset);
+    if (levels != NULL) {
+      levels[depth].hashes++;
+      levels[depth].keys += object->size;
+    }
+    for (unsigned long i = 0; i < object->size; i++) {
+      const i_snapshot_child_t *child = &children[i];
+      stats->key_bytes += child->key_size;
+      collect_stats(store, snapshot_view(store, (i_snapshot_node_t *)SNAPSHOT_AT(child, child->node), &view), depth + 1, stats, levels);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+static void
+add_node_stats(i_node_stats_t *total, i_node_stats_t *stats)
+{
+  for (int i = 0; i <= i_type_snapshot_hash; i++)
+    total->nodes[i] += stats->nodes[i];
+  total->string_bytes += stats->string_bytes;
+  total->key_bytes += stats->key_bytes;
+  if (stats->depth > total->depth)
+    total->depth = stats->depth;
+}
+
+static VALUE
+node_stats_to_rhash(i_node_stats_t *stats)
+{
+  VALUE nodes = rb_hash_new(),
+        result = rb_hash_new();
+  for (int i = i_type_string; i <= i_type_null; i++)
+    rb_hash_aset(nodes, ID2SYM(rb_intern(i_object_type_names[i])), ULONG2NUM(stats->nodes[i]));
+  rb_hash_aset(result, ID2SYM(rb_intern("nodes")), nodes);
+  rb_hash_aset(result, ID2SYM(rb_intern("string_bytes")), SIZET2NUM(stats->string_bytes));
+  rb_hash_aset(result, ID2SYM(rb_intern("key_bytes")), SIZET2NUM(stats->key_bytes));
+  return result;
+}
+
+static size_t memsize_translations(const void *ptr);
+static size_t memsize_key_cache(const void *ptr);
+
+/*
+ * Adds every key and scalar under object to seen, so string_pool_stats
+ * can tell which pooled strings are still in use
+ */
+static void
+collect_used_strings(i_object_t *object, st_table *seen)
+{
+  switch (object->type) {
+  case i_type_hash:
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next) {
+      st_insert(seen, (st_data_t)kv->key, 0);
+      collect_used_strings(kv->value, seen);
+    }
+    break;
+  case i_type_array:
+    for (unsigned long i = 0; i < object->size; i++)
+      collect_used_strings(&object->data.array[i], seen);
+    break;
+  case i_type_string:
+  case i_type_int:
+  case i_type_float:
+  case i_type_symbol:
+    st_insert(seen, (st_data_t)object->data.string, 0);
+    break;
+  default:
+    break;
+  }
+}
+
+static VALUE
+string_pool_stats(i_translations_t *store)
+{
+  i_string_pool_t *pool = &store->pool;
+  unsigned long strings = 0, hits = 0, misses = 0, orphaned = 0;
+  size_t bytes = 0, saved = 0, orphaned_bytes = 0;
+  VALUE result = rb_hash_new();
+  st_table *seen = st_init_numtable();
+
+  // nothing else points into the pool; sources keep their own copies,
+  // and compressed locales have already let go of theirs
+  collect_used_strings(&store->root, seen);
+  for (int i = 0; i < I_POOL_SHARDS; i++) {
+    i_pool_shard_t *shard = &pool->shards[i];
+    LOCK_POOL_SHARD(shard);
+    strings += shard->count;
+    hits += shard->hits;
+    misses += shard->misses;
+    saved += shard->saved;
+    if (shard->arena != NULL)
+      bytes += shard->arena->used;
+    for (unsigned long j = 0; j < shard->capacity; j++) {
+      i_pool_entry_t *entry = &shard->entries[j];
+      if (entry->str == NULL || st_is_member(seen, (st_data_t)entry->str))
+        continue;
+      orphaned++;
+      orphaned_bytes += entry->len + 1;
+      if (entry->templated)
+        orphaned_bytes += sizeof(i_template_t *) + sizeof(i_template_t) + sizeof(i_template_segment_t) * (*(i_template_t **)(entry->str - sizeof(i_template_t *)))->num_segments;
+    }
+    UNLOCK_POOL_SHARD(shard);
+  }
+  st_free_table(seen);
+  rb_hash_aset(result, ID2SYM(rb_intern("strings")), ULONG2NUM(strings));
+  rb_hash_aset(result, ID2SYM(rb_intern("bytes")), SIZET2NUM(bytes));
+  rb_hash_aset(result, ID2SYM(rb_intern("hits")), ULONG2NUM(hits));
+  rb_hash_aset(result, ID2SYM(rb_intern("misses")), ULONG2NUM(misses));
+  rb_hash_aset(result, ID2SYM(rb_intern("hit_rate")), rb_float_new(hits + misses ? (double)hits / (hits + misses) : 0.0));
+  rb_hash_aset(result, ID2SYM(rb_intern("bytes_saved")), SIZET2NUM(saved));
+  rb_hash_aset(result, ID2SYM(rb_intern("orphaned")), ULONG2NUM(orphaned));
+  rb_hash_aset(result, ID2SYM(rb_intern("orphaned_bytes")), SIZET2NUM(orphaned_bytes));
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     backend.stats -> hash
+ *
+ *  Returns a breakdown of what the backend is holding: node counts by
+ *  type and string/key bytes (overall and per locale), hash table stats
+ *  for each level of the tree (level 0 being the locales), the size of
+ *  the normalized key cache, the string pool and frozen string cache (if
+ *  enabled), and the total memory used. The pool's orphaned strings are
+ *  the ones nothing uses anymore (since store_translations or
+ *  reload_changed! replaced them); they're only freed by reload!.
+ *
+ *     backend.stats  #=> {nodes: {string: 5120, array: 12, hash: 830, ...},
+ *                    #    string_bytes: 201344, key_bytes: 61230,
+ *                    #    levels: [{hashes: 1, keys: 2, buckets: 32, max_chain: 1}, ...],
+ *                    #    locales: {en: {nodes: {...}, string_bytes: 100500, key_bytes: 30615}, ...},
+ *                    #    key_cache: {entries: 1234, bytes: 98765},
+ *                    #    string_pool: {strings: 4100, bytes: 150211, hits: 1950, misses: 4100, hit_rate: 0.32, bytes_saved: 51200,
+ *                    #                   orphaned: 12, orphaned_bytes: 640},
+ *                    #    string_cache: {entries: 3200, free: 12},
+ *                    #    memsize: 1327104}
+ */
+
+static VALUE
+stats(VALUE self)
+{
+  i_translations_t *store = translation_store_get(self);
+  i_key_cache_t *cache = key_cache_get(self);
+  i_node_stats_t total, locale_stats;
+  i_level_stats_t *levels;
+  i_object_t *root = &store->root;
+  i_object_t view;
+  VALUE result, locales, level_list, key_cache, tmp;
+
+  // first pass (per locale) for the counts and depth, second for the levels
+  memset(&total, 0, sizeof(i_node_stats_t));
+  locales = rb_hash_new();
+  if (root->type == i_type_hash) {
+    for (i_key_value_t *kv = root->data.hash; kv != NULL; kv = kv->hh.next) {
+      memset(&locale_stats, 0, sizeof(i_node_stats_t));
+      collect_stats(store, kv->value, 1, &locale_stats, NULL);
+      add_node_stats(&total, &locale_stats);
+      rb_hash_aset(locales, ID2SYM(rb_intern(kv->key)), node_stats_to_rhash(&locale_stats));
+    }
+  } else {
+    const i_snapshot_child_t *children = (i_snapshot_child_t *)SNAPSHOT_AT(root->data.snapshot, root->data.snapshot->offset);
+    for (unsigned long i = 0; i < root->size; i++) {
+      const i_snapshot_child_t *child = &children[i];
+      memset(&locale_stats, 0, sizeof(i_node_stats_t));
+      collect_stats(store, snapshot_view(store, (i_snapshot_node_t *)SNAPSHOT_AT(child, child->node), &view), 1, &locale_stats, NULL);
+      add_node_stats(&total, &locale_stats);
+      rb_hash_aset(locales, ID2SYM(rb_intern(SNAPSHOT_AT(child, child->key))), node_stats_to_rhash(&locale_stats));
+    }
+  }
+
+  levels = ALLOCV_N(i_level_stats_t, tmp, total.depth + 1);
+  memset(levels, 0, sizeof(i_level_stats_t) * (total.depth + 1));
+  memset(&locale_stats, 0, sizeof(i_node_stats_t));
+  collect_stats(store, root, 0, &locale_stats, levels);
+  level_list = rb_ary_new();
+  for (unsigned long i = 0; i <= total.depth && levels[i].hashes > 0; i++) {
+    VALUE level = rb_hash_new();
+    rb_hash_aset(level, ID2SYM(rb_intern("hashes")), ULONG2NUM(levels[i].hashes));
+    rb_hash_aset(level, ID2SYM(rb_intern("keys")), ULONG2NUM(levels[i].keys));
+    rb_hash_aset(level, ID2SYM(rb_intern("buckets")), ULONG2NUM(levels[i].buckets));
+    rb_hash_aset(level, ID2SYM(rb_intern("max_chain")), ULONG2NUM(levels[i].max_chain));
+    rb_ary_push(level_list, level);
+  }
+  ALLOCV_END(tmp);
+
+  key_cache = rb_hash_new();
+  rb_hash_aset(key_cache, ID2SYM(rb_intern("entries")), ULONG2NUM(cache->count));
+  rb_hash_aset(key_cache, ID2SYM(rb_intern("bytes")), SIZET2NUM(cache->bytes));
+
+  result = node_stats_to_rhash(&total);
+  rb_hash_aset(result, ID2SYM(rb_intern("levels")), level_list);
+  rb_hash_aset(result, ID2SYM(rb_intern("locales")), locales);
+  rb_hash_aset(result, ID2SYM(rb_intern("key_cache")), key_cache);
+  if (store->pool.enabled)
+    rb_hash_aset(result, ID2SYM(rb_intern("string_pool")), string_pool_stats(store));
+  if (store->string_cache.enabled) {
+    VALUE string_cache = rb_hash_new();
+    rb_hash_aset(string_cache, ID2SYM(rb_intern("entries")), ULONG2NUM(store->string_cache.count - store->string_cache.num_free));
+    rb_hash_aset(string_cache, ID2SYM(rb_intern("free")), ULONG2NUM(store->string_cache.num_free));
+    rb_hash_aset(result, ID2SYM(rb_intern("string_cache")), string_cache);
+  }
+  rb_hash_aset(result, ID2SYM(rb_intern("memsize")), SIZET2NUM(memsize_translations(store) + memsize_key_cache(cache)));
+  return result;
+}
+
+/*
+ * Roughly what object and everything under it take up in an arena
+ */
+static size_t
+tree_size(i_object_t *object)
+{
+  size_t size = 0;
+  switch (object->type) {
+  case i_type_array:
+    for (unsigned long i = 0; i < object->size; i++)
+      size += tree_size(&object->data.array[i]);
+    break;
+  case i_type_hash:
+    if (object->data.hash != NULL)
+      size += sizeof(UT_hash_table) + object->data.hash->hh.tbl->num_buckets * sizeof(UT_hash_bucket);
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next)
+      size += sizeof(i_key_value_t) + kv->hh.keylen + 1 + sizeof(i_object_t) + tree_size(kv->value);
+    break;
+  case i_type_true:
+  case i_type_false:
+  case i_type_null:
+    break;
+  default:
+    size += object->size + 1;
+    if (object->templated)
+      size += sizeof(i_template_t *) + sizeof(i_template_t) + sizeof(i_template_segment_t) * (*(i_template_t **)(object->data.string - sizeof(i_template_t *)))->num_segments;
+    break;
+  }
+  return size;
+}
+
+static i_cold_locale_t*
+cold_locale_record(i_translations_t *store, const char *locale, unsigned long len)
+{
+  i_cold_locale_t *cold;
+  i_arena_t *previous_uthash_arena = uthash_arena;
+  HASH_FIND(hh, store->cold_locales, locale, len, cold);
+  if (cold == NULL) {
+    cold = ALLOC(i_cold_locale_t);
+    memset(cold, 0, sizeof(i_cold_locale_t));
+    cold->locale = new_string(NULL, (char *)locale, len);
+    cold->last_used = store->idle_round;
+    uthash_arena = NULL; // unlike the tree, the table is on the heap
+    HASH_ADD_KEYPTR(hh, store->cold_locales, cold->locale, len, cold);
+    uthash_arena = previous_uthash_arena;
+  }
+  return cold;
+}
+
+static void
+clear_cold_locales(i_translations_t *store)
+{
+  i_cold_locale_t *cold, *tmp;
+  i_arena_t *previous_uthash_arena = uthash_arena;
+  uthash_arena = NULL;
+  HASH_ITER(hh, store->cold_locales, cold, tmp) {
+    HASH_DEL(store->cold_locales, cold);
+    xfree(cold->locale);
+    xfree(cold->blob);
+    xfree(cold);
+  }
+  uthash_arena = previous_uthash_arena;
+}
+
+/*
+ * Frees the arena of every source whose locales are all compressed now.
+ * Sources that were just thawed from a blob have nothing else to them,
+ * so those go too.
+ */
+static void
+release_cold_arenas(i_translations_t *store)
+{
+  i_source_t **current = &store->sources;
+  i_cold_locale_t *cold;
+  store->last_source = &store->sources;
+  while (*current != NULL) {
+    i_source_t *source = *current;
+    int all_cold = source->arena != NULL && source->subtrees != NULL;
+    const char *id = source->subtrees;
+    for (unsigned long i = 0; all_cold && i < source->num_subtrees; i++, id += strlen(id) + 1) {
+      if (is_subtree(id))
+        continue;
+      HASH_FIND_STR(store->cold_locales, id, cold);
+      all_cold = cold != NULL && cold->blob != NULL;
+    }
+    if (all_cold) {
+      remove_arena(store, source->arena);
+      source->arena = NULL;
+      source->subtrees = NULL;
+      source->num_subtrees = 0;
+      if (source->path == NULL && source->yml == NULL && source->tree == NULL) {
+        *current = source->next;
+        delete_source(source);
+        continue;
+      }
+    }
+    current = &source->next;
+    store->last_source = current;
+  }
+}
+
+/*
+ * Deflates each of locales (Strings) that is in the tree, and takes it
+ * out. Returns how many there were.
+ */
+static long
+compress_cold_locales(i_translations_t *store, long num_locales, const VALUE *locales)
+{
+  i_arena_t *spine = new_arena(0), *previous_uthash_arena = uthash_arena;
+  i_key_value_t *kv, *tmp;
+  i_object_t root;
+  long count = 0;
+
+  // anything cached might belong to arenas that are about to go
+  clear_string_cache(&store->string_cache, 1);
+  uthash_arena = spine;
+  for (long i = 0; i < num_locales; i++) {
+    const char *locale = RSTRING_PTR(locales[i]);
+    unsigned long len = RSTRING_LEN(locales[i]);
+    HASH_FIND(hh, store->root.data.hash, locale, len, kv);
+    if (kv == NULL || kv->value->type != i_type_hash)
+      continue;
+
+    i_cold_locale_t *cold = cold_locale_record(store, locale, len);
+    char *data = build_snapshot(kv->value, "", 0);
+    cold->raw_size = ((i_snapshot_header_t *)data)->file_size;
+#ifdef HAVE_LIBZ
+    uLongf blob_size = compressBound(cold->raw_size);
+    cold->blob = ALLOC_N(char, blob_size);
+    int status = compress2((Bytef *)cold->blob, &blob_size, (Bytef *)data, cold->raw_size, Z_DEFAULT_COMPRESSION);
+    xfree(data);
+    if (status != Z_OK) {
+      xfree(cold->blob);
+      cold->blob = NULL;
+      continue; // it just stays in the tree
+    }
+    REALLOC_N(cold->blob, char, blob_size);
+    cold->blob_size = blob_size;
+#else
+    cold->blob = data;
+    cold->blob_size = cold->raw_size;
+#endif
+    HASH_DEL(store->root.data.hash, kv);
+    count++;
+  }
+  if (count == 0) {
+    uthash_arena = previous_uthash_arena;
+    delete_arena(spine);
+    return 0;
+  }
+
+  // the root table may well be in an arena that's about to go
+  root.type = i_type_hash;
+  root.data.hash = NULL;
+  HASH_ITER(hh, store->root.data.hash, kv, tmp)
+    HASH_ADD_KEYPTR(hh, root.data.hash, kv->key, kv->hh.keylen, kv);
+  store->root.data.hash = root.data.hash;
+  uthash_arena = previous_uthash_arena;
+  if (store->cold_spine != NULL)
+    remove_arena(store, store->cold_spine);
+  store->cold_spine = spine;
+  spine->next = store->arenas;
+  store->arenas = spine;
+
+  release_cold_arenas(store);
+  // sources no longer own everything they list
+  store->incremental = 0;
+  translations_changed(store);
+  return count;
+}
+
+/*
+ * Inflates a compressed locale back into the tree, in an arena (and
+ * source) of its own
+ */
+static void
+warm_cold_locale(i_translations_t *store, i_cold_locale_t *cold)
+{
+  char *data = cold->blob;
+  i_arena_t *arena, *previous_uthash_arena = uthash_arena;
+  i_object_t root;
+  i_key_value_t *kv;
+
+#ifdef HAVE_LIBZ
+  uLongf raw_size = cold->raw_size;
+  data = ALLOC_N(char, cold->raw_size);
+  if (uncompress((Bytef *)data, &raw_size, (Bytef *)cold->blob, cold->blob_size) != Z_OK || raw_size != cold->raw_size) {
+    xfree(data);
+    rb_raise(rb_eRuntimeError, "compressed translations for %s are corrupt", cold->locale);
+  }
+#endif
+  arena = new_arena(cold->raw_size);
+  kv = new_key_value(arena, new_string(arena, cold->locale, strlen(cold->locale)), thaw_snapshot_data(arena, data));
+
+  uthash_arena = arena;
+  root.type = i_type_hash;
+  root.data.hash = NULL;
+  HASH_ADD_KEYPTR(hh, root.data.hash, kv->key, strlen(kv->key), kv);
+  add_source(store, new_source(NULL, NULL, 0, NULL), arena, &root);
+  HASH_ADD_KEYPTR(hh, store->root.data.hash, kv->key, strlen(kv->key), kv);
+  uthash_arena = previous_uthash_arena;
+  arena->next = store->arenas;
+  store->arenas = arena;
+  translations_changed(store);
+
+  xfree(cold->blob);
+  cold->blob = NULL;
+  cold->blob_size = 0;
+#ifdef HAVE_LIBZ
+  xfree(data);
+#endif
+}
+
+static void
+warm_cold_locales(i_translations_t *store)
+{
+  for (i_cold_locale_t *cold = store->cold_locales; cold != NULL; cold = cold->hh.next)
+    if (cold->blob != NULL)
+      warm_cold_locale(store, cold);
+}
+
+/*
+ * Called on every lookup once there are cold locales (see ensure_locale);
+ * notes that locale (nil for all of them) has been used, and inflates it
+ * if need be
+ */
+static void
+touch_cold_locale(i_translations_t *store, VALUE locale)
+{
+  i_cold_locale_t *cold;
+  if (NIL_P(locale)) {
+    warm_cold_locales(store);
+    return;
+  }
+  HASH_FIND(hh, store->cold_locales, RSTRING_PTR(locale), RSTRING_LEN(locale), cold);
+  if (cold == NULL)
+    return;
+  cold->last_used = store->idle_round;
+  if (cold->blob != NULL)
+    warm_cold_locale(store, cold);
+}
+
+/*
+ *  call-seq:
+ *     backend.deflate_locales(locales) -> count
+ *
+ *  Swaps the translations of each of locales (Strings) for a deflated
+ *  snapshot of them, which gets inflated back into the tree on the next
+ *  lookup in that locale. Returns how many were compressed. Most callers
+ *  want compress_locales.
+ */
+
+static VALUE
+deflate_locales(VALUE self, VALUE locales)
+{
+  i_translations_t *store = writable_store(self);
+  Check_Type(locales, T_ARRAY);
+  locales = rb_ary_dup(locales);
+  for (long i = 0; i < RARRAY_LEN(locales); i++)
+    Check_Type(RARRAY_PTR(locales)[i], T_STRING);
+  if (store->snapshot != NULL)
+    return INT2FIX(0); // its pages are shared as it is
+  long count = compress_cold_locales(store, RARRAY_LEN(locales), RARRAY_PTR(locales));
+  RB_GC_GUARD(locales);
+  return LONG2NUM(count);
+}
+
+/*
+ *  call-seq:
+ *     backend.compress_idle_locales -> locales
+ *
+ *  Compresses (see compress_locales) every locale that hasn't been looked
+ *  up since the last call, and returns them. The first call just starts
+ *  keeping track, so call it periodically (e.g. every ten minutes), and
+ *  whatever isn't getting traffic gets compressed. Locales that get
+ *  loaded in between are left alone until the call after next.
+ *
+ *     backend.compress_idle_locales   #=> [:de, :"pt-BR"]
+ */
+
+static VALUE
+compress_idle_locales(VALUE self)
+{
+  i_translations_t *store = writable_store(self);
+  VALUE idle = rb_ary_new(), result = rb_ary_new();
+
+  if (store->snapshot != NULL)
+    return result;
+  for (i_key_value_t *kv = store->root.data.hash; kv != NULL; kv = kv->hh.next) {
+    i_cold_locale_t *cold = cold_locale_record(store, kv->key, kv->hh.keylen);
+    if (store->idle_round > 0 && cold->last_used < store->idle_round)
+      rb_ary_push(idle, rb_str_new(kv->key, kv->hh.keylen));
+  }
+  store->idle_round++;
+  compress_cold_locales(store, RARRAY_LEN(idle), RARRAY_PTR(idle));
+  for (long i = 0; i < RARRAY_LEN(idle); i++)
+    rb_ary_push(result, rb_str_intern(RARRAY_PTR(idle)[i]));
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     backend.locale_sizes -> hash
+ *
+ *  Returns roughly how many bytes each locale's tree takes up (resident,
+ *  0 for compressed locales), and for compressed locales, the size of the
+ *  deflated snapshot (compressed) and of the snapshot itself
+ *  (uncompressed).
+ *
+ *     backend.locale_sizes   #=> {en: {resident: 1310720, compressed: nil}, de: {resident: 0, compressed: 98304, uncompressed: 1048576}}
+ */
+
+static VALUE
+locale_sizes(VALUE self)
+{
+  i_translations_t *store = translation_store_get(self);
+  VALUE result = rb_hash_new();
+  if (store->snapshot == NULL) {
+    for (i_key_value_t *kv = store->root.data.hash; kv != NULL; kv = kv->hh.next) {
+      VALUE sizes = rb_hash_new();
+      rb_hash_aset(sizes, ID2SYM(rb_intern("resident")), SIZET2NUM(tree_size(kv->value)));
+      rb_hash_aset(sizes, ID2SYM(rb_intern("compressed")), Qnil);
+      rb_hash_aset(result, ID2SYM(rb_intern(kv->key)), sizes);
+    }
+  }
+  for (i_cold_locale_t *cold = store->cold_locales; cold != NULL; cold = cold->hh.next) {
+    if (cold->blob == NULL)
+      continue;
+    VALUE sizes = rb_hash_new();
+    rb_hash_aset(sizes, ID2SYM(rb_intern("resident")), INT2FIX(0));
+    rb_hash_aset(sizes, ID2SYM(rb_intern("compressed")), SIZET2NUM(cold->blob_size));
+    rb_hash_aset(sizes, ID2SYM(rb_intern("uncompressed")), SIZET2NUM(cold->raw_size));
+    rb_hash_aset(result, ID2SYM(rb_intern(cold->locale)), sizes);
+  }
+  return result;
+}
+
+static VALUE
+key_to_str(VALUE key)
+{
+  if (SYMBOL_P(key))
+#ifdef HAVE_RB_SYM2STR
+    return rb_sym2str(key);
+#else
+    return rb_id2str(SYM2ID(key));
+#endif
+  if (TYPE(key) != T_STRING)
+    key = rb_funcall(key, s_to_s, 0);
+  StringValue(key);
+  return key;
+}
+
+/*
+ * Splits key the way String#split(separator) does, minus the empty parts.
+ * Just counts them if target is NULL.
+ */
+static long
+split_key(VALUE key, VALUE separator, i_object_t *target)
+{
+  const char *start = RSTRING_PTR(key),
+             *end = start + RSTRING_LEN(key),
+             *sep = RSTRING_PTR(separator);
+  long sep_len = RSTRING_LEN(separator),
+       num_parts = 0;
+  int awk = sep_len == 1 && *sep == ' '; // i.e. split on runs of whitespace
+  rb_encoding *enc = rb_enc_get(key);
+
+  while (start < end) {
+    const char *p = start;
+    long match = 0;
+    if (sep_len == 0) {
+      p += rb_enc_mbclen(p, end, enc); // one part per character
+    }
+    else {
+      for (; p < end; p += rb_enc_mbclen(p, end, enc))
+        if (awk ? rb_isspace((unsigned char)*p) : end - p >= sep_len && memcmp(p, sep, sep_len) == 0)
+          break;
+      if (p < end)
+        match = awk ? 1 : sep_len;
+    }
+    if (p > start) {
+      if (target != NULL)
+        set_string_object(NULL, &target->data.array[num_parts], (char *)start, p - start);
+      num_parts++;
+    }
+    start = p + match;
+  }
+  return num_parts;
+}
+
+static i_key_cache_map_t*
+key_cache_map(i_key_cache_t *cache, VALUE separator)
+{
+  i_key_cache_map_t *map = NULL;
+
+  HASH_FIND(hh, cache->maps, RSTRING_PTR(separator), RSTRING_LEN(separator), map);
+  if (map != NULL)
+    return map;
+
+  map = ALLOC(i_key_cache_map_t);
+  map->separator = new_string(NULL, RSTRING_PTR(separator), RSTRING_LEN(separator));
+  map->strings = NULL;
+  map->symbols = NULL;
+  HASH_ADD_KEYPTR(hh, cache->maps, map->separator, RSTRING_LEN(separator), map);
+  return map;
+}
+
+static void
+delete_key_cache_entry(i_key_cache_entry_t *entry)
+{
+  xfree(entry->key);
+  delete_object_r(entry->parts);
+  xfree(entry);
+}
+
+static void
+evict_key_cache_entry(i_key_cache_t *cache, i_key_cache_entry_t *entry)
+{
+  if (entry->key == NULL)
+    HASH_DEL(entry->map->symbols, entry);
+  else
+    HASH_DEL(entry->map->strings, entry);
+  cache->clock[entry->slot] = cache->clock[--cache->count];
+  cache->clock[entry->slot]->slot = entry->slot;
+  cache->bytes -= entry->bytes;
+  cache->evictions++;
+  delete_key_cache_entry(entry);
+}
+
+static int
+key_cache_full(i_key_cache_t *cache)
+{
+  return (cache->max_entries > 0 && cache->count > cache->max_entries) ||
+         (cache->max_bytes > 0 && cache->bytes > cache->max_bytes);
+}
+
+/*
+ * Evicts down to the limits; the hand clears referenced bits as it goes
+ * and takes the first entry that hasn't been used since its last pass
+ */
+static void
+trim_key_cache(i_key_cache_t *cache)
+{
+  while (cache->count > 0 && key_cache_full(cache)) {
+    if (cache->hand >= cache->count)
+      cache->hand = 0;
+    i_key_cache_entry_t *entry = cache->clock[cache->hand];
+    if (entry->referenced) {
+      entry->referenced = 0;
+      cache->hand++;
+    } else {
+      evict_key_cache_entry(cache, entry); // the last entry takes its slot
+    }
+  }
+}
+
+static void
+clear_key_cache(i_key_cache_t *cache)
+{
+  i_key_cache_map_t *map, *tmp;
+  // tables first, since clearing them reads the head entries
+  HASH_ITER(hh, cache->maps, map, tmp) {
+    HASH_CLEAR(hh, map->strings);
+    HASH_CLEAR(hh, map->symbols);
+    HASH_DEL(cache->maps, map);
+    xfree(map->separator);
+    xfree(map);
+  }
+  for (unsigned long i = 0; i < cache->count; i++)
+    delete_key_cache_entry(cache->clock[i]);
+  cache->count = 0;
+  cache->hand = 0;
+  cache->bytes = 0;
+}
+
+static void
+delete_key_cache(void *ptr)
+{
+  i_key_cache_t *cache = ptr;
+  clear_key_cache(cache);
+  xfree(cache->clock);
+  xfree(cache);
+}
+
+/*
+ * Returns the cached parts array for key (a String or Symbol), caching
+ * it first if need be
+ */
+static i_object_t*
+normalized_key_parts(i_key_cache_t *cache, i_key_cache_map_t *map, VALUE key, VALUE separator)
+{
+  i_key_cache_entry_t *entry = NULL;
+  ID symbol = 0;
+
+  if (SYMBOL_P(key) && I_STATIC_SYM_P(key)) {
+    symbol = SYM2ID(key);
+    HASH_FIND(hh, map->symbols, &symbol, sizeof(ID), entry);
+  } else {
+    key = key_to_str(key);
+    HASH_FIND(hh, map->strings, RSTRING_PTR(key), RSTRING_LEN(key), entry);
+  }
+  if (entry != NULL) {
+    cache->hits++;
+    if (!entry->referenced) // so pages shared after a fork stay that way
+      entry->referenced = 1;
+    return entry->parts;
+  }
+
+  cache->misses++;
+  key = key_to_str(key);
+  entry = ALLOC(i_key_cache_entry_t);
+  entry->map = map;
+  entry->symbol = symbol;
+  entry->key = NULL;
+  entry->key_len = RSTRING_LEN(key);
+  entry->referenced = 0;
+  entry->parts = new_array_object(NULL, split_key(key, separator, NULL));
+  split_key(key, separator, entry->parts);
+  entry->bytes = sizeof(i_key_cache_entry_t) + sizeof(i_object_t) * (entry->parts->size + 1);
+  for (unsigned long i = 0; i < entry->parts->size; i++)
+    entry->bytes += entry->parts->data.array[i].size + 1;
+  if (symbol != 0) {
+    HASH_ADD(hh, map->symbols, symbol, sizeof(ID), entry);
+  } else {
+    entry->key = new_string(NULL, RSTRING_PTR(key), RSTRING_LEN(key));
+    entry->bytes += entry->key_len + 1;
+    HASH_ADD_KEYPTR(hh, map->strings, entry->key, entry->key_len, entry);
+  }
+
+  if (cache->count == cache->capacity) {
+    cache->capacity = cache->capacity == 0 ? 256 : cache->capacity * 2;
+    REALLOC_N(cache->clock, i_key_cache_entry_t *, cache->capacity);
+  }
+  entry->slot = cache->count;
+  cache->clock[cache->count++] = entry;
+  cache->bytes += entry->bytes;
+  return entry->parts;
+}
+
+/*
+ * Converts anything in key that isn't a String or Symbol, so that walking
+ * it afterwards won't call back into Ruby
+ */
+static VALUE
+stringify_key(VALUE key)
+{
+  if (TYPE(key) == T_ARRAY) {
+    VALUE copy = Qnil;
+    for (long i = 0; i < RARRAY_LEN(key); i++) {
+      VALUE item = RARRAY_PTR(key)[i],
+            str = stringify_key(item);
+      if (str != item) {
+        if (NIL_P(copy))
+          copy = rb_ary_dup(key);
+        rb_ary_store(copy, i, str);
+      }
+    }
+    return NIL_P(copy) ? key : copy;
+  }
+  if (SYMBOL_P(key) || TYPE(key) == T_STRING)
+    return key;
+  return key_to_str(key);
+}
+
+static VALUE
+join_array_key(VALUE self, VALUE key, VALUE separator)
+{
+  long len = RARRAY_LEN(key);
+  if (len == 0)
+    return rb_str_new("", 0);
+
+  VALUE ret = rb_ary_join(normalize_key(self, RARRAY_PTR(key)[0], separator), separator);
+  for (long i = 1; i < len; i++) {
+    rb_str_concat(ret, separator);
+    rb_str_concat(ret, rb_ary_join(normalize_key(self, RARRAY_PTR(key)[i], separator), separator));
+  }
+  return ret;
+}
+
+/*
+ *  call-seq:
+ *     backend.normalize_key(key, separator) -> key
+ *
+ *  Normalizes and splits a key based on the separator.
+ *
+ *     backend.normalize_key "asdf", "."    #=> ["asdf"]
+ *     backend.normalize_key "a.b.c", "."   #=> ["a", "b", "c"]
+ *     backend.normalize_key "a.b.c", ":"   #=> ["a.b.c"]
+ *     backend.normalize_key %{a b.c}, "."  #=> ["a", "b", "c"]
+ */
+
+static VALUE
+normalize_key(VALUE self, VALUE key, VALUE separator)
+{
+  Check_Type(separator, T_STRING);
+  StringValueCStr(separator);
+
+  i_key_cache_t *cache = key_cache_get(self);
+  if (TYPE(key) == T_ARRAY)
+    key = join_array_key(self, key, separator);
+  else
+    key = stringify_key(key);
+  VALUE result = i_object_to_robject(normalized_key_parts(cache, key_cache_map(cache, separator), key, separator), NULL);
+  trim_key_cache(cache);
+  return result;
+}
+
+/*
+ * Appends the cached parts of key (or of each of its elements, if it's an
+ * array) to parts, up to capacity. Returns the total number of parts, so
+ * the caller can retry with a bigger buffer.
+ */
+static long
+add_key_parts(i_key_cache_t *cache, i_key_cache_map_t *map, VALUE key, VALUE separator, i_key_part_t *parts, long num_parts, long capacity)
+{
+  if (TYPE(key) == T_ARRAY) {
+    for (long i = 0; i < RARRAY_LEN(key); i++)
+      num_parts = add_key_parts(cache, map, RARRAY_PTR(key)[i], separator, parts, num_parts, capacity);
+    return num_parts;
+  }
+
+  i_object_t *key_frd = normalized_key_parts(cache, map, key, separator);
+  for (unsigned long i = 0; i < key_frd->size; i++, num_parts++) {
+    if (num_parts < capacity) {
+      parts[num_parts].key = key_frd->data.array[i].data.string;
+      parts[num_parts].len = key_frd->data.array[i].size;
+    }
+  }
+  return num_parts;
+}
+
+static long
+add_lookup_parts(i_key_cache_t *cache, i_key_cache_map_t *map, VALUE locale, VALUE key, VALUE scope, VALUE separator, i_key_part_t *parts, long capacity)
+{
+  parts[0].key = RSTRING_PTR(locale);
+  parts[0].len = RSTRING_LEN(locale);
+  long num_parts = 1;
+  if (!NIL_P(scope))
+    num_parts = add_key_parts(cache, map, scope, separator, parts, num_parts, capacity);
+  return add_key_parts(cache, map, key, separator, parts, num_parts, capacity);
+}
+
+/*
+ * Builtin plural rules, named as in rails-i18n. Only Integer and Float
+ * counts get anything but "other" (except for the default rule, which
+ * goes by count == 1 like I18n's)
+ */
+static int
+plural_count(VALUE count, double *n, int *integral)
+{
+  if (FIXNUM_P(count)) {
+    *n = (double)FIX2LONG(count);
+    *integral = 1;
+    return 1;
+  }
+  if (RB_FLOAT_TYPE_P(count) || TYPE(count) == T_BIGNUM) {
+    *n = NUM2DBL(count);
+    *integral = isfinite(*n) && floor(*n) == *n;
+    return 1;
+  }
+  return 0;
+}
+
+static const char*
+plural_rule_one_other(VALUE count)
+{
+  if (FIXNUM_P(count))
+    return count == INT2FIX(1) ? "one" : "other";
+  return RTEST(rb_equal(count, INT2FIX(1))) ? "one" : "other";
+}
+
+static const char*
+plural_rule_one_upto_two_other(VALUE count)
+{
+  double n;
+  int integral;
+  return plural_count(count, &n, &integral) && n >= 0 && n < 2 ? "one" : "other";
+}
+
+static const char*
+plural_rule_other(VALUE count)
+{
+  return "other";
+}
+
+static const char*
+plural_rule_east_slavic(VALUE count)
+{
+  double n;
+  int integral;
+  if (!plural_count(count, &n, &integral) || !integral)
+    return "other";
+  double mod10 = fabs(fmod(n, 10)),
+         mod100 = fabs(fmod(n, 100));
+  if (mod10 == 1 && mod100 != 11)
+    return "one";
+  if (mod10 >= 2 && mod10 <= 4 && !(mod100 >= 12 && mod100 <= 14))
+    return "few";
+  return "many";
+}
+
+static const char*
+plural_rule_west_slavic(VALUE count)
+{
+  double n;
+  int integral;
+  if (!plural_count(count, &n, &integral))
+    return "other";
+  if (n == 1)
+    return "one";
+  return integral && n >= 2 && n <= 4 ? "few" : "other";
+}
+
+static const char*
+plural_rule_polish(VALUE count)
+{
+  double n;
+  int integral;
+  if (!plural_count(count, &n, &integral))
+    return "other";
+  if (n == 1)
+    return "one";
+  if (!integral)
+    return "other";
+  double mod10 = fabs(fmod(n, 10)),
+         mod100 = fabs(fmod(n, 100));
+  if (mod10 >= 2 && mod10 <= 4 && !(mod100 >= 12 && mod100 <= 14))
+    return "few";
+  return "many";
+}
+
+static const struct {
+  const char *name;
+  i_plural_rule_fn fn;
+} builtin_plural_rules[] = {
+  {"one_other", plural_rule_one_other},
+  {"one_upto_two_other", plural_rule_one_upto_two_other},
+  {"other", plural_rule_other},
+  {"east_slavic", plural_rule_east_slavic},
+  {"west_slavic", plural_rule_west_slavic},
+  {"polish", plural_rule_polish}
+};
+
+/*
+ * The plural key for count, sans the :zero special case
+ */
+static i_plural_rule_t*
+find_plural_rule(i_translations_t *store, VALUE locale_str)
+{
+  i_plural_rule_t *rule = NULL;
+  HASH_FIND(hh, store->plural_rules, RSTRING_PTR(locale_str), RSTRING_LEN(locale_str), rule);
+  return rule;
+}
+
+static VALUE
+plural_key_for(i_translations_t *store, VALUE locale_str, VALUE count, const char **key)
+{
+  i_plural_rule_t *rule = find_plural_rule(store, locale_str);
+  if (rule == NULL || rule->fn != NULL) {
+    *key = (rule == NULL ? plural_rule_one_other : rule->fn)(count);
+    return Qnil;
+  }
+
+  VALUE result = key_to_str(rb_funcall(rule->callable, s_call, 1, count));
+  *key = StringValueCStr(result);
+  return result;
+}
+
+static int
+plural_count_zero(VALUE count)
+{
+  if (FIXNUM_P(count))
+    return count == INT2FIX(0);
+  return RTEST(rb_equal(count, INT2FIX(0)));
+}
+
+static i_object_t*
+find_child(i_translations_t *store, i_object_t *hash, const char *key, i_object_t *view)
+{
+  i_key_part_t part = {key, strlen(key)};
+  if (hash->type == i_type_snapshot_hash) {
+    const i_snapshot_node_t *child = snapshot_find_child(hash->data.snapshot, part.key, part.len);
+    return child == NULL ? NULL : snapshot_view(store, child, view);
+  }
+  return hash_get(hash, &part, 1);
+}
+
+/*
+ * Picks the plural branch of entry for count, same as I18n's pluralize
+ * (but with this backend's plural rules). Only String branches are picked
+ * here; anything else (including a missing branch) comes back as the
+ * whole entry, and the Ruby side's pluralize deals with it. So does every
+ * entry if pluralize has been overridden (e.g. by
+ * I18n::Backend::Pluralization), unless the locale has a plural_rule.
+ */
+static i_object_t*
+pluralize_object(i_translations_t *store, VALUE locale_str, i_object_t *entry, VALUE count, i_object_t *view)
+{
+  const char *key;
+  i_object_t *branch = NULL;
+
+  if (entry->type != i_type_hash && entry->type != i_type_snapshot_hash)
+    return entry;
+  if (store->ruby_plurals && find_plural_rule(store, locale_str) == NULL)
+    return entry;
+  if (plural_count_zero(count))
+    branch = find_child(store, entry, "zero", view);
+  if (branch == NULL) {
+    VALUE key_str = plural_key_for(store, locale_str, count, &key);
+    branch = find_child(store, entry, key, view);
+    RB_GC_GUARD(key_str);
+  }
+  return branch != NULL && branch->type == i_type_string ? branch : entry;
+}
+
+/*
+ *  call-seq:
+ *     backend.plural_rule(locale, rule) -> rule
+ *
+ *  Sets the plural rule for locale (String or Symbol), which is either the
+ *  name of a builtin rule (:one_other, :one_upto_two_other, :other,
+ *  :east_slavic, :west_slavic, :polish), anything that responds to call
+ *  (given the count, returning the plural key), or nil to go back to the
+ *  default (:one_other).
+ *
+ *     backend.plural_rule :ru, :east_slavic
+ *     backend.plural_rule :fr, ->(n) { n < 2 ? :one : :other }
+ */
+
+static VALUE
+set_plural_rule(VALUE self, VALUE locale, VALUE rule)
+{
+  i_translations_t *store = writable_store(self);
+  i_plural_rule_t *entry = NULL;
+  i_plural_rule_fn fn = NULL;
+  VALUE locale_str = key_to_str(locale);
+
+  if (SYMBOL_P(rule)) {
+    VALUE name = key_to_str(rule);
+    for (size_t i = 0; i < sizeof(builtin_plural_rules) / sizeof(builtin_plural_rules[0]); i++)
+      if (strcmp(builtin_plural_rules[i].name, StringValueCStr(name)) == 0)
+        fn = builtin_plural_rules[i].fn;
+    if (fn == NULL)
+      rb_raise(rb_eArgError, "unknown plural rule %s", StringValueCStr(name));
+  } else if (!NIL_P(rule) && !rb_respond_to(rule, s_call)) {
+    rb_raise(rb_eArgError, "plural rule should be a Symbol or respond to call");
+  }
+
+  entry = find_plural_rule(store, locale_str);
+  if (entry != NULL) {
+    HASH_DEL(store->plural_rules, entry);
+    xfree(entry->locale);
+    xfree(entry);
+  }
+  if (!NIL_P(rule)) {
+    entry = ALLOC(i_plural_rule_t);
+    entry->locale = new_string(NULL, RSTRING_PTR(locale_str), RSTRING_LEN(locale_str));
+    entry->fn = fn;
+    entry->callable = fn == NULL ? rule : Qnil;
+    HASH_ADD_KEYPTR(hh, store->plural_rules, entry->locale, RSTRING_LEN(locale_str), entry);
+  }
+  return rule;
+}
+
+/*
+ *  call-seq:
+ *     backend.plural_key(locale, count) -> key
+ *
+ *  The plural key locale's rule gives for count (not counting the :zero
+ *  special case).
+ *
+ *     backend.plural_key :en, 1   #=> :one
+ *     backend.plural_key :ru, 3   #=> :few
+ */
+
+static VALUE
+plural_key(VALUE self, VALUE locale, VALUE count)
+{
+  const char *key;
+  VALUE key_str = plural_key_for(translation_store_get(self), key_to_str(locale), count, &key);
+  VALUE result = ID2SYM(rb_intern(key));
+  RB_GC_GUARD(key_str);
+  return result;
+}
 
-  i_object_t *key_map = normalized_key_cache_get(self),
-             *sub_map = hash_get(key_map, &separator, 1);
-  if (sub_map == NULL) {
-    sub_map = new_hash_object();
-    char *key = new_string(RSTRING_PTR(separator), RSTRING_LEN(separator));
-    i_key_value_t *kv = new_key_value(key, sub_map);
-    add_key_value(&key_map->data.hash, kv);
+/*
+ *  call-seq:
+ *     backend.ruby_plurals = enabled -> enabled
+ *
+ *  When enabled, lookups only pick plural branches for locales with a
+ *  plural_rule, and leave the rest to pluralize in Ruby.
+ */
+
+static VALUE
+set_ruby_plurals(VALUE self, VALUE enabled)
+{
+  writable_store(self)->ruby_plurals = RTEST(enabled);
+  return enabled;
+}
+
+static void
+load_reserved_keys(void)
+{
+  if (NIL_P(reserved_keys))
+    reserved_keys = rb_const_get(rb_const_get(rb_cObject, rb_intern("I18n")), rb_intern("RESERVED_KEYS"));
+}
+
+static int
+is_reserved_key(VALUE key)
+{
+  load_reserved_keys();
+  if (TYPE(reserved_keys) == T_ARRAY)
+    return RTEST(rb_ary_includes(reserved_keys, key));
+  return RTEST(rb_funcall(reserved_keys, rb_intern("include?"), 1, key));
+}
+
+static i_template_t*
+object_template(i_object_t *object)
+{
+  return *(i_template_t **)(object->data.string - sizeof(i_template_t *));
+}
+
+static ID
+template_segment_name(i_template_segment_t *segment, const char *str)
+{
+  if (segment->name == 0)
+    segment->name = rb_intern3(str + segment->offset, segment->len, rb_utf8_encoding());
+  return segment->name;
+}
+
+/*
+ * Interns the placeholder names of every template under object up front,
+ * rather than on first use, since once frozen the templates are shared
+ * by lookups in any number of Ractors
+ */
+static void
+intern_template_names(i_object_t *object)
+{
+  switch (object->type) {
+  case i_type_hash:
+    for (i_key_value_t *kv = object->data.hash; kv != NULL; kv = kv->hh.next)
+      intern_template_names(kv->value);
+    break;
+  case i_type_array:
+    for (unsigned long i = 0; i < object->size; i++)
+      intern_template_names(&object->data.array[i]);
+    break;
+  case i_type_string:
+    if (object->templated) {
+      i_template_t *template = object_template(object);
+      for (unsigned long i = 0; i < template->num_segments; i++)
+        if (template->segments[i].type != i_segment_literal)
+          template_segment_name(&template->segments[i], object->data.string);
+    }
+    break;
+  default:
+    break;
   }
+}
 
-  if (TYPE(key) == T_ARRAY)
-    key = join_array_key(self, key, separator);
-  else if (TYPE(key) != T_STRING)
-    key = rb_funcall(key, s_to_s, 0);
+/*
+ * Interpolates values into a string entry the way I18n.interpolate would,
+ * into a single buffer sized up front. Anything out of the ordinary
+ * (missing or reserved keys, values that aren't a Hash) is handed off to
+ * Ruby's interpolate, so errors and custom handlers work the same.
+ */
+static VALUE
+interpolate_object(VALUE self, VALUE locale, i_object_t *object, VALUE values, i_translations_t *store)
+{
+  const char *str = object->data.string;
+  i_template_t *template;
+  VALUE tmp = 0,
+        result,
+        resolved_ary = Qnil,
+        stack_values[I_TEMPLATE_STACK_VALUES],
+        *resolved = stack_values;
+  unsigned long size, num_resolved = 0;
+
+  if (memchr(str, '%', object->size) == NULL)
+    return i_object_to_robject(object, store);
+  if (TYPE(values) != T_HASH)
+    return rb_funcall(self, s_interpolate, 3, locale, i_object_to_robject(object, store), values);
+
+  if (object->templated) {
+    template = object_template(object);
+  } else {
+    // e.g. a snapshot string, so compile a throwaway template
+    long num_segments = compile_template(str, object->size, NULL);
+    if (num_segments == 0)
+      return i_object_to_robject(object, store);
+    if (num_segments < 0)
+      return rb_funcall(self, s_interpolate, 3, locale, i_object_to_robject(object, store), values);
+    template = (i_template_t *)ALLOCV(tmp, sizeof(i_template_t) + sizeof(i_template_segment_t) * num_segments);
+    compile_template(str, object->size, template);
+  }
+
+  for (unsigned long i = 0; i < template->num_segments; i++) {
+    i_template_segment_t *segment = &template->segments[i];
+    if (segment->type == i_segment_literal)
+      continue;
+    VALUE key = ID2SYM(template_segment_name(segment, str));
+    if ((segment->type == i_segment_placeholder && is_reserved_key(key)) || rb_hash_lookup2(values, key, Qundef) == Qundef) {
+      if (tmp)
+        ALLOCV_END(tmp);
+      return rb_funcall(self, s_interpolate, 3, locale, i_object_to_robject(object, store), values);
+    }
+  }
+
+  if (template->num_placeholders > I_TEMPLATE_STACK_VALUES) {
+    resolved_ary = rb_ary_new2(template->num_placeholders);
+    resolved = NULL;
+  }
+  size = template->literal_size;
+  for (unsigned long i = 0; i < template->num_segments; i++) {
+    i_template_segment_t *segment = &template->segments[i];
+    if (segment->type == i_segment_literal)
+      continue;
+    VALUE value = rb_hash_lookup2(values, ID2SYM(segment->name), Qnil);
+    if (rb_respond_to(value, s_call))
+      value = rb_funcall(value, s_call, 1, values);
+    if (segment->type == i_segment_format) {
+      VALUE format = rb_str_new(NULL, segment->format_len + 1);
+      RSTRING_PTR(format)[0] = '%';
+      memcpy(RSTRING_PTR(format) + 1, str + segment->format_offset, segment->format_len);
+      value = rb_str_format(1, &value, format);
+    }
+    value = rb_obj_as_string(value);
+    size += RSTRING_LEN(value);
+    if (resolved == NULL)
+      rb_ary_push(resolved_ary, value);
+    else
+      resolved[num_resolved] = value;
+    num_resolved++;
+  }
+
+  result = rb_str_buf_new(size);
+  rb_enc_associate(result, rb_utf8_encoding());
+  num_resolved = 0;
+  for (unsigned long i = 0; i < template->num_segments; i++) {
+    i_template_segment_t *segment = &template->segments[i];
+    if (segment->type == i_segment_literal)
+      rb_str_buf_cat(result, str + segment->offset, segment->len);
+    else
+      rb_str_buf_append(result, resolved == NULL ? RARRAY_PTR(resolved_ary)[num_resolved++] : resolved[num_resolved++]);
+  }
+  if (tmp)
+    ALLOCV_END(tmp);
+  RB_GC_GUARD(resolved_ary);
+  return result;
+}
+
+/*
+ * Looks key (and scope) up under each of locale_strs in turn, resolving
+ * them against the key cache just once, and returns the first hit (with
+ * the plural branch for count picked, if given) or NULL. *found is set
+ * to the index of the locale it came from
+ */
+static i_object_t*
+lookup_in_locales(VALUE self, long num_locales, VALUE *locale_strs, VALUE key, VALUE scope, VALUE separator, VALUE count, i_object_t *view, i_object_t *branch_view, long *found)
+{
+  i_translations_t *store = translation_store_get(self);
+  i_key_part_t stack_parts[I_LOOKUP_STACK_PARTS], *parts = stack_parts;
+  i_key_cache_t *cache = key_cache_get(self);
+  i_key_cache_map_t *map;
+  i_object_t *result = NULL;
+  long i, num_parts;
+  int follow_links;
+  VALUE parts_tmp = 0;
+
+  Check_Type(separator, T_STRING);
+  StringValueCStr(separator);
+  // I18n resolves symbols relative to the scope, with the separator given
+  follow_links = (NIL_P(scope) || (TYPE(scope) == T_ARRAY && RARRAY_LEN(scope) == 0)) &&
+                 RSTRING_LEN(separator) == 1 && *RSTRING_PTR(separator) == '.';
+  // lazy locales get loaded (in Ruby) before we touch the cache
+  for (i = 0; i < num_locales; i++)
+    ensure_locale(self, store, locale_strs[i]);
+  key = stringify_key(key);
+  if (!NIL_P(scope))
+    scope = stringify_key(scope);
+
+  // nothing calls back into Ruby until we're done with the cached parts
+  map = key_cache_map(cache, separator);
+  num_parts = add_lookup_parts(cache, map, locale_strs[0], key, scope, separator, parts, I_LOOKUP_STACK_PARTS);
+  if (num_parts > I_LOOKUP_STACK_PARTS) {
+    parts = ALLOCV_N(i_key_part_t, parts_tmp, num_parts);
+    add_lookup_parts(cache, map, locale_strs[0], key, scope, separator, parts, num_parts);
+  }
+  for (i = 0; i < num_locales; i++) {
+    parts[0].key = RSTRING_PTR(locale_strs[i]);
+    parts[0].len = RSTRING_LEN(locale_strs[i]);
+    result = translations_lookup(store, parts, num_parts, view);
+    if (result != NULL && result->type == i_type_symbol && follow_links)
+      result = follow_symbol_link(store, result);
+    if (result != NULL && result->type != i_type_null)
+      break;
+    result = NULL;
+  }
+  if (profile_sample_p(store)) {
+    // misses count against the first locale in the chain
+    if (result == NULL) {
+      parts[0].key = RSTRING_PTR(locale_strs[0]);
+      parts[0].len = RSTRING_LEN(locale_strs[0]);
+    }
+    profile_lookup(store, parts, num_parts, result);
+  }
+  ALLOCV_END(parts_tmp);
+  trim_key_cache(cache);
+  *found = result == NULL ? -1 : i;
+  if (result != NULL && !NIL_P(count))
+    result = pluralize_object(store, locale_strs[i], result, count, branch_view);
+  RB_GC_GUARD(key);
+  RB_GC_GUARD(scope);
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     backend.native_lookup(locale, key, scope, separator[, values[, count]]) -> localized_str
+ *
+ *  Equivalent to normalize_keys + direct_lookup, but the key and scope
+ *  (Strings, Symbols or Arrays thereof) are resolved against the
+ *  normalized key cache and the tree is walked with the cached parts, so
+ *  no intermediate strings or arrays get allocated.
+ *
+ *  If values are given and the entry is a String, it comes back already
+ *  interpolated (using the template precompiled at load time). If count
+ *  is given and the entry is a plural Hash, the branch for count is
+ *  picked first, before anything gets converted.
+ *
+ *     backend.native_lookup(:en, "bar", [:foo], ".")   #=> "lol"
+ *     backend.native_lookup(:en, "foo.bar", nil, ".")  #=> "lol"
+ *     backend.native_lookup(:en, "hi", nil, ".", name: "bob")  #=> "hi bob"
+ */
+
+static VALUE
+native_lookup(int argc, VALUE *argv, VALUE self)
+{
+  i_object_t view, branch_view, *result;
+  VALUE locale, locale_str, key, scope, separator, values, count;
+  long found;
+
+  rb_scan_args(argc, argv, "42", &locale, &key, &scope, &separator, &values, &count);
+  locale_str = key_to_str(locale);
+  result = lookup_in_locales(self, 1, &locale_str, key, scope, separator, count, &view, &branch_view, &found);
+  RB_GC_GUARD(locale_str);
+  if (result != NULL && result->type == i_type_string && !NIL_P(values))
+    return interpolate_object(self, locale, result, values, translation_store_get(self));
+  return i_object_to_robject(result, translation_store_get(self));
+}
+
+/*
+ *  call-seq:
+ *     backend.fallback_lookup(locales, key, scope, separator[, values[, count]]) -> [localized_str, locale] or nil
+ *
+ *  Like native_lookup, but probes each of locales (e.g. the
+ *  I18n.fallbacks chain) in turn, with the key and scope resolved against
+ *  the key cache just once. Returns the first entry found (nil doesn't
+ *  count) along with the locale it came from, or nil if none of them
+ *  have it. The plural branch is picked with the rule of that locale.
+ *
+ *     backend.fallback_lookup([:"fr-CA", :fr, :en], "foo.bar", nil, ".")  #=> ["lol", :en]
+ */
+
+static VALUE
+fallback_lookup(int argc, VALUE *argv, VALUE self)
+{
+  i_object_t view, branch_view, *result;
+  VALUE locales, key, scope, separator, values, count, robject, *locale_strs, locale_strs_tmp = 0, result_locale;
+  long i, num_locales, found;
+
+  rb_scan_args(argc, argv, "42", &locales, &key, &scope, &separator, &values, &count);
+  locales = rb_Array(locales);
+  num_locales = RARRAY_LEN(locales);
+  if (num_locales == 0)
+    return Qnil;
+  // the originals come after the strings, in case locales gets changed
+  // while lazy locales are loading
+  locale_strs = ALLOCV_N(VALUE, locale_strs_tmp, num_locales * 2);
+  MEMCPY(locale_strs + num_locales, RARRAY_PTR(locales), VALUE, num_locales);
+  for (i = 0; i < num_locales; i++)
+    locale_strs[i] = key_to_str(locale_strs[num_locales + i]);
+  result = lookup_in_locales(self, num_locales, locale_strs, key, scope, separator, count, &view, &branch_view, &found);
+  if (result == NULL) {
+    ALLOCV_END(locale_strs_tmp);
+    return Qnil;
+  }
+  result_locale = locale_strs[num_locales + found];
+  ALLOCV_END(locale_strs_tmp);
+  if (result->type == i_type_string && !NIL_P(values))
+    robject = interpolate_object(self, result_locale, result, values, translation_store_get(self));
+  else
+    robject = i_object_to_robject(result, translation_store_get(self));
+  RB_GC_GUARD(locales);
+  return rb_assoc_new(robject, result_locale);
+}
+
+/*
+ *  call-seq:
+ *     backend.native_lookup_many(locale, keys, scope, separator) -> [localized_str]
+ *
+ *  Same as calling native_lookup for each of keys (without values or
+ *  count), but in one go: locale and scope are resolved and walked just
+ *  once, and each key is looked up under that. Returns the entries in
+ *  the same order as keys, with nil for any that are missing.
+ *
+ *     backend.native_lookup_many(:en, [:bar, :baz], [:foo], ".")   #=> ["lol", nil]
+ */
+
+static VALUE
+native_lookup_many(VALUE self, VALUE locale, VALUE keys, VALUE scope, VALUE separator)
+{
+  i_translations_t *store = translation_store_get(self);
+  i_key_cache_t *cache = key_cache_get(self);
+  i_key_cache_map_t *map;
+  i_key_part_t *parts;
+  i_object_t prefix_view, *prefix, *views, **results;
+  VALUE locale_str, result, parts_tmp = 0, views_tmp = 0, results_tmp = 0;
+  long num_keys, prefix_len, num_parts, capacity = I_LOOKUP_STACK_PARTS;
+  unsigned long generation;
+  int follow_links;
+
+  Check_Type(keys, T_ARRAY);
+  Check_Type(separator, T_STRING);
+  StringValueCStr(separator);
+  locale_str = key_to_str(locale);
+  follow_links = (NIL_P(scope) || (TYPE(scope) == T_ARRAY && RARRAY_LEN(scope) == 0)) &&
+                 RSTRING_LEN(separator) == 1 && *RSTRING_PTR(separator) == '.';
+  ensure_locale(self, store, locale_str);
+  keys = stringify_key(keys);
+  if (!NIL_P(scope))
+    scope = stringify_key(scope);
+  num_keys = RARRAY_LEN(keys);
+  views = ALLOCV_N(i_object_t, views_tmp, num_keys);
+  results = ALLOCV_N(i_object_t *, results_tmp, num_keys);
+
+  // as with lookup_in_locales, nothing calls back into Ruby until every
+  // entry has been found
+  map = key_cache_map(cache, separator);
+  parts = ALLOCV_N(i_key_part_t, parts_tmp, capacity);
+  parts[0].key = RSTRING_PTR(locale_str);
+  parts[0].len = RSTRING_LEN(locale_str);
+  prefix_len = NIL_P(scope) ? 1 : add_key_parts(cache, map, scope, separator, parts, 1, capacity);
+  if (prefix_len > capacity) {
+    ALLOCV_END(parts_tmp);
+    capacity = prefix_len * 2;
+    parts = ALLOCV_N(i_key_part_t, parts_tmp, capacity);
+    parts[0].key = RSTRING_PTR(locale_str);
+    parts[0].len = RSTRING_LEN(locale_str);
+    add_key_parts(cache, map, scope, separator, parts, 1, capacity);
+  }
+  prefix = translations_lookup(store, parts, prefix_len, &prefix_view);
+
+  for (long i = 0; i < num_keys; i++) {
+    VALUE key = RARRAY_PTR(keys)[i];
+    num_parts = add_key_parts(cache, map, key, separator, parts, prefix_len, capacity);
+    if (num_parts > capacity) {
+      i_key_part_t *grown;
+      VALUE grown_tmp = 0;
+      capacity = num_parts * 2;
+      grown = ALLOCV_N(i_key_part_t, grown_tmp, capacity);
+      MEMCPY(grown, parts, i_key_part_t, prefix_len);
+      ALLOCV_END(parts_tmp);
+      parts = grown;
+      parts_tmp = grown_tmp;
+      add_key_parts(cache, map, key, separator, parts, prefix_len, capacity);
+    }
+    results[i] = translations_lookup_under(store, prefix, parts, prefix_len, num_parts, &views[i]);
+    if (results[i] == &prefix_view) {
+      views[i] = prefix_view;
+      results[i] = &views[i];
+    }
+    if (results[i] != NULL && results[i]->type == i_type_symbol && follow_links)
+      results[i] = follow_symbol_link(store, results[i]);
+    if (profile_sample_p(store))
+      profile_lookup(store, parts, num_parts, results[i]);
+  }
+  trim_key_cache(cache);
+
+  // converting can call into Ruby (and let other threads in)
+  generation = store->generation;
+  result = rb_ary_new2(num_keys);
+  for (long i = 0; i < num_keys; i++) {
+    if (store->generation != generation)
+      rb_raise(rb_eRuntimeError, "translations changed while looking up");
+    rb_ary_store(result, i, i_object_to_robject(results[i], store));
+  }
+  ALLOCV_END(parts_tmp);
+  ALLOCV_END(views_tmp);
+  ALLOCV_END(results_tmp);
+  RB_GC_GUARD(locale_str);
+  RB_GC_GUARD(keys);
+  RB_GC_GUARD(scope);
+  return result;
+}
+
+static size_t
+key_cache_limit(VALUE limit)
+{
+  if (NIL_P(limit))
+    return 0;
+  long value = NUM2LONG(limit);
+  if (value < 0)
+    rb_raise(rb_eArgError, "limit can't be negative");
+  return (size_t)value;
+}
+
+/*
+ *  call-seq:
+ *     backend.key_cache_max_entries = max -> max
+ *
+ *  Caps the number of normalized keys that get cached (100,000 by
+ *  default). Set it to nil for no limit.
+ */
 
-  i_object_t *key_frd = hash_get(sub_map, &key, 1);
+static VALUE
+set_key_cache_max_entries(VALUE self, VALUE max)
+{
+  i_key_cache_t *cache = key_cache_get(self);
+  cache->max_entries = key_cache_limit(max);
+  trim_key_cache(cache);
+  return max;
+}
+
+/*
+ *  call-seq:
+ *     backend.key_cache_max_bytes = max -> max
+ *
+ *  Caps the (approximate) memory used by the normalized key cache. Off by
+ *  default; set it to nil to turn it back off.
+ */
+
+static VALUE
+set_key_cache_max_bytes(VALUE self, VALUE max)
+{
+  i_key_cache_t *cache = key_cache_get(self);
+  cache->max_bytes = key_cache_limit(max);
+  trim_key_cache(cache);
+  return max;
+}
+
+/*
+ *  call-seq:
+ *     backend.prewarm_key_cache(keys, separator) -> num_entries
+ *
+ *  Normalizes and caches each of keys (Strings, Symbols, or Arrays of
+ *  them) for separator, e.g. before forking so that workers share the
+ *  cache. Prewarmed entries start out referenced, so hits on them don't
+ *  dirty their pages, and don't count towards the hit/miss stats.
+ */
+
+static void
+prewarm_key(i_key_cache_t *cache, i_key_cache_map_t *map, VALUE key, VALUE separator)
+{
+  // same as what native_lookup caches, i.e. array keys by element
+  if (TYPE(key) == T_ARRAY) {
+    for (long i = 0; i < RARRAY_LEN(key); i++)
+      prewarm_key(cache, map, RARRAY_PTR(key)[i], separator);
+    return;
+  }
+  normalized_key_parts(cache, map, key, separator);
+}
+
+static VALUE
+prewarm_key_cache(VALUE self, VALUE keys, VALUE separator)
+{
+  i_key_cache_t *cache = key_cache_get(self);
+  unsigned long hits = cache->hits, misses = cache->misses;
+
+  Check_Type(keys, T_ARRAY);
+  Check_Type(separator, T_STRING);
+  StringValueCStr(separator);
+  keys = stringify_key(keys);
+  prewarm_key(cache, key_cache_map(cache, separator), keys, separator);
+  for (unsigned long i = 0; i < cache->count; i++)
+    if (!cache->clock[i]->referenced)
+      cache->clock[i]->referenced = 1;
+  cache->hits = hits;
+  cache->misses = misses;
+  trim_key_cache(cache);
+  RB_GC_GUARD(keys);
+  return ULONG2NUM(cache->count);
+}
+
+/*
+ *  call-seq:
+ *     backend.key_cache_keys -> hash
+ *
+ *  Returns the keys in the normalized key cache, by separator, split up
+ *  into Strings and Symbols.
+ *
+ *     backend.key_cache_keys  #=> {"." => {"strings" => ["foo.bar"], "symbols" => [:baz]}}
+ */
+
+static VALUE
+key_cache_keys(VALUE self)
+{
+  i_key_cache_t *cache = key_cache_get(self);
+  VALUE result = rb_hash_new();
+  for (i_key_cache_map_t *map = cache->maps; map != NULL; map = map->hh.next) {
+    VALUE strings = rb_ary_new(),
+          symbols = rb_ary_new(),
+          keys = rb_hash_new();
+    for (i_key_cache_entry_t *entry = map->strings; entry != NULL; entry = entry->hh.next)
+      rb_ary_push(strings, rb_enc_str_new(entry->key, entry->key_len, rb_utf8_encoding()));
+    for (i_key_cache_entry_t *entry = map->symbols; entry != NULL; entry = entry->hh.next)
+      rb_ary_push(symbols, ID2SYM(entry->symbol));
+    rb_hash_aset(keys, rb_str_new2("strings"), strings);
+    rb_hash_aset(keys, rb_str_new2("symbols"), symbols);
+    rb_hash_aset(result, rb_enc_str_new(map->separator, map->hh.keylen, rb_utf8_encoding()), keys);
+  }
+  return result;
+}
+
+typedef struct i_profile_walk
+{
+  i_translations_t *store;
+  VALUE hot;
+  VALUE dead;
+  char *buffer; // the current dot-separated path
+  unsigned long buffer_size;
+} i_profile_walk_t;
+
+static void profile_walk(i_profile_walk_t *walk, i_object_t *hash_object, uint64_t hash, unsigned long path_len, int used);
+
+static void
+profile_walk_child(i_profile_walk_t *walk, const char *key, unsigned long key_len, i_object_t *value, uint64_t hash, unsigned long path_len, int used)
+{
+  unsigned long offset = path_len == 0 ? 0 : path_len + 1;
+  if (offset + key_len > walk->buffer_size) {
+    walk->buffer_size = (offset + key_len) * 2;
+    REALLOC_N(walk->buffer, char, walk->buffer_size);
+  }
+  if (offset > 0)
+    walk->buffer[path_len] = '.';
+  memcpy(walk->buffer + offset, key, key_len);
+
+  uint64_t child_hash = path_hash_part(hash, key, key_len);
+  unsigned long hits = profile_hits(&walk->store->profile, child_hash);
+  VALUE path = Qnil;
+  if (hits > 0 || (!used && value->type != i_type_hash && value->type != i_type_snapshot_hash))
+    path = rb_enc_str_new(walk->buffer, offset + key_len, rb_utf8_encoding());
+  if (hits > 0)
+    rb_ary_push(walk->hot, rb_assoc_new(path, ULONG2NUM(hits)));
+  if (value->type == i_type_hash || value->type == i_type_snapshot_hash)
+    profile_walk(walk, value, child_hash, offset + key_len, used || hits > 0);
+  else if (!used && hits == 0)
+    rb_ary_push(walk->dead, path);
+}
 
-  if (key_frd == NULL) {
-    char *sep = StringValueCStr(separator);
-    VALUE parts = rb_str_split(key, sep);
-    long parts_len = RARRAY_LEN(parts),
-         skipped = 0;
-    key_frd = new_array_object(parts_len);
-    for (long i = 0; i < parts_len; i++) {
-      VALUE part = RARRAY_PTR(parts)[i];
-      // TODO: don't alloc for empty strings, since we discard them
-      if (RSTRING_LEN(part) == 0)
-        skipped++;
-      else
-        set_string_object(&key_frd->data.array[i - skipped], RSTRING_PTR(part), RSTRING_LEN(part));
+/*
+ * Collects every path with sampled hits, and every leaf that neither it
+ * nor anything above it was ever seen
+ */
+static void
+profile_walk(i_profile_walk_t *walk, i_object_t *hash_object, uint64_t hash, unsigned long path_len, int used)
+{
+  if (hash_object->type == i_type_hash) {
+    for (i_key_value_t *kv = hash_object->data.hash; kv != NULL; kv = kv->hh.next)
+      profile_walk_child(walk, kv->key, kv->hh.keylen, kv->value, hash, path_len, used);
+  } else {
+    const i_snapshot_node_t *node = hash_object->data.snapshot;
+    const i_snapshot_child_t *children = (i_snapshot_child_t *)SNAPSHOT_AT(node, node->offset);
+    i_object_t view;
+    for (unsigned long i = 0; i < node->size; i++) {
+      const i_snapshot_child_t *child = &children[i];
+      i_object_t *value = snapshot_view(walk->store, (i_snapshot_node_t *)SNAPSHOT_AT(child, child->node), &view);
+      profile_walk_child(walk, SNAPSHOT_AT(child, child->key), child->key_size, value, hash, path_len, used);
     }
-    key_frd->size -= skipped;
+  }
+}
+
+static VALUE
+profile_walk_ensure(VALUE arg)
+{
+  xfree(((i_profile_walk_t *)arg)->buffer);
+  return Qnil;
+}
+
+static VALUE
+profile_walk_run(VALUE arg)
+{
+  i_profile_walk_t *walk = (i_profile_walk_t *)arg;
+  profile_walk(walk, &walk->store->root, I_FNV_OFFSET, 0, 0);
+  return Qnil;
+}
+
+/*
+ *  call-seq:
+ *     backend.key_profile_rate = rate -> rate
+ *
+ *  Turns on lookup profiling for key_profile, sampling one in every rate
+ *  lookups (1 samples all of them). nil turns it back off. Either way,
+ *  whatever has been collected so far is thrown away.
+ *
+ *     backend.key_profile_rate = 100
+ */
+
+static VALUE
+set_key_profile_rate(VALUE self, VALUE rate)
+{
+  i_translations_t *store = writable_store(self);
+  long value = NIL_P(rate) ? 0 : NUM2LONG(rate);
+  if (value < 0)
+    rb_raise(rb_eArgError, "rate can't be negative");
+  store->profile.rate = (unsigned long)value;
+  clear_key_profile(&store->profile);
+  return rate;
+}
+
+/*
+ *  call-seq:
+ *     backend.key_profile_data -> hash
+ *
+ *  What key_profile is made of: every full key (locale included) with
+ *  sampled hits, every leaf that was never seen (nor anything above it),
+ *  and every key that was looked up but missing. Counts are of sampled
+ *  lookups, so multiply by sample_rate for an estimate of the real ones.
+ *
+ *     backend.key_profile_data  #=> {sample_rate: 100, samples: 1234, hot: [["en.foo.bar", 1000], ...], dead: ["en.baz", ...], missing: [["en.nope", 4], ...], dropped_misses: 0}
+ */
+
+static VALUE
+key_profile_data(VALUE self)
+{
+  i_translations_t *store = translation_store_get(self);
+  i_key_profile_t *profile = &store->profile;
+  i_profile_walk_t walk;
+  VALUE result = rb_hash_new(), missing = rb_ary_new();
+
+  walk.store = store;
+  walk.hot = rb_ary_new();
+  walk.dead = rb_ary_new();
+  walk.buffer_size = 256;
+  walk.buffer = ALLOC_N(char, walk.buffer_size);
+  rb_ensure(profile_walk_run, (VALUE)&walk, profile_walk_ensure, (VALUE)&walk);
+
+  if (profile->misses != NULL)
+    for (unsigned long i = 0; i < I_PROFILE_MAX_MISSES * 2; i++)
+      if (profile->misses[i].count != 0)
+        rb_ary_push(missing, rb_assoc_new(rb_enc_str_new_cstr(profile->misses[i].key, rb_utf8_encoding()), ULONG2NUM(profile->misses[i].count)));
+
+  rb_hash_aset(result, ID2SYM(rb_intern("sample_rate")), profile->rate ? ULONG2NUM(profile->rate) : Qnil);
+  rb_hash_aset(result, ID2SYM(rb_intern("samples")), ULONG2NUM(profile->samples));
+  rb_hash_aset(result, ID2SYM(rb_intern("hot")), walk.hot);
+  rb_hash_aset(result, ID2SYM(rb_intern("dead")), walk.dead);
+  rb_hash_aset(result, ID2SYM(rb_intern("missing")), missing);
+  rb_hash_aset(result, ID2SYM(rb_intern("dropped_misses")), ULONG2NUM(profile->dropped_misses));
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     backend.key_cache_stats -> hash
+ *
+ *  Returns the size and hit/miss/eviction counts of the normalized key
+ *  cache, for sizing its limits.
+ *
+ *     backend.key_cache_stats  #=> {entries: 1234, bytes: 98765, max_entries: 100000, max_bytes: nil, hits: 456789, misses: 1500, evictions: 266}
+ */
+
+static VALUE
+key_cache_stats(VALUE self)
+{
+  i_key_cache_t *cache = key_cache_get(self);
+  VALUE result = rb_hash_new();
+  rb_hash_aset(result, ID2SYM(rb_intern("entries")), ULONG2NUM(cache->count));
+  rb_hash_aset(result, ID2SYM(rb_intern("bytes")), SIZET2NUM(cache->bytes));
+  rb_hash_aset(result, ID2SYM(rb_intern("max_entries")), cache->max_entries ? ULONG2NUM(cache->max_entries) : Qnil);
+  rb_hash_aset(result, ID2SYM(rb_intern("max_bytes")), cache->max_bytes ? SIZET2NUM(cache->max_bytes) : Qnil);
+  rb_hash_aset(result, ID2SYM(rb_intern("hits")), ULONG2NUM(cache->hits));
+  rb_hash_aset(result, ID2SYM(rb_intern("misses")), ULONG2NUM(cache->misses));
+  rb_hash_aset(result, ID2SYM(rb_intern("evictions")), ULONG2NUM(cache->evictions));
+  return result;
+}
+
+static size_t
+arenas_memsize(i_arena_t *arena)
+{
+  size_t size = 0;
+  for (; arena != NULL; arena = arena->next)
+    size += sizeof(i_arena_t) + arena->num_chunks * sizeof(i_arena_chunk_t) + arena->allocated;
+  return size;
+}
+
+static size_t
+uthash_memsize(UT_hash_table *table)
+{
+  if (table == NULL)
+    return 0;
+  return sizeof(UT_hash_table) + table->num_buckets * sizeof(UT_hash_bucket);
+}
+
+/*
+ * The tree (hash tables and templates included) lives entirely in the
+ * arenas, so there's no need to walk it. Mapped snapshots aren't counted,
+ * since their pages belong to the page cache.
+ */
+static size_t
+memsize_translations(const void *ptr)
+{
+  const i_translations_t *store = ptr;
+  size_t size = sizeof(i_translations_t) + arenas_memsize(store->arenas);
+  size += store->index.capacity * sizeof(i_path_entry_t) + arenas_memsize(store->index.paths);
+  size += store->string_cache.capacity * sizeof(i_cached_string_t);
+  for (int i = 0; i < I_POOL_SHARDS; i++)
+    size += store->pool.shards[i].capacity * sizeof(i_pool_entry_t) + arenas_memsize(store->pool.shards[i].arena);
+  size += store->profile.hits_capacity * sizeof(i_profile_entry_t);
+  if (store->profile.misses != NULL)
+    size += I_PROFILE_MAX_MISSES * 2 * sizeof(i_profile_entry_t);
+  if (store->snapshot != NULL) {
+    size += sizeof(i_snapshot_t);
+    if (!store->snapshot->mapped)
+      size += store->snapshot->size;
+    if (store->string_cache.snapshot_slots != NULL)
+      size += ((i_snapshot_header_t *)store->snapshot->data)->node_count * sizeof(unsigned int);
+  }
+  for (i_source_t *source = store->sources; source != NULL; source = source->next)
+    size += sizeof(i_source_t) + (source->path ? strlen(source->path) + 1 : 0) + (source->yml ? source->yml_len + 1 : 0) +
+            (source->locale ? strlen(source->locale) + 1 : 0) +
+            (source->tree ? ((i_snapshot_header_t *)source->tree)->file_size : 0);
+  for (i_plural_rule_t *rule = store->plural_rules; rule != NULL; rule = rule->hh.next)
+    size += sizeof(i_plural_rule_t) + strlen(rule->locale) + 1;
+  if (store->plural_rules != NULL)
+    size += uthash_memsize(store->plural_rules->hh.tbl);
+  for (i_cold_locale_t *cold = store->cold_locales; cold != NULL; cold = cold->hh.next)
+    size += sizeof(i_cold_locale_t) + strlen(cold->locale) + 1 + cold->blob_size;
+  if (store->cold_locales != NULL)
+    size += uthash_memsize(store->cold_locales->hh.tbl);
+  return size;
+}
+
+static size_t
+memsize_key_cache(const void *ptr)
+{
+  const i_key_cache_t *cache = ptr;
+  size_t size = sizeof(i_key_cache_t) + cache->capacity * sizeof(i_key_cache_entry_t *) + cache->bytes;
+  for (i_key_cache_map_t *map = cache->maps; map != NULL; map = map->hh.next) {
+    size += sizeof(i_key_cache_map_t) + map->hh.keylen + 1;
+    if (map->strings != NULL)
+      size += uthash_memsize(map->strings->hh.tbl);
+    if (map->symbols != NULL)
+      size += uthash_memsize(map->symbols->hh.tbl);
+  }
+  if (cache->maps != NULL)
+    size += uthash_memsize(cache->maps->hh.tbl);
+  return size;
+}
+
+static void
+mark_translations(void *ptr)
+{
+  i_translations_t *store = ptr;
+  i_string_cache_t *cache = &store->string_cache;
+  for (unsigned long i = 0; i < cache->count; i++)
+    rb_gc_mark(cache->entries[i].rstring);
+  for (i_plural_rule_t *rule = store->plural_rules; rule != NULL; rule = rule->hh.next)
+    rb_gc_mark(rule->callable);
+}
 
-    char *key_orig = new_string(RSTRING_PTR(key), RSTRING_LEN(key));
-    i_key_value_t *kv = new_key_value(key_orig, key_frd);
-    add_key_value(&sub_map->data.hash, kv);
+static void
+delete_translations(void *ptr)
+{
+  i_translations_t *store = ptr;
+  i_plural_rule_t *rule, *tmp;
+  clear_translations(store);
+  clear_string_pool(&store->pool);
+  clear_key_profile(&store->profile);
+#ifdef HAVE_RUBY_THREAD_NATIVE_H
+  for (int i = 0; i < I_POOL_SHARDS; i++)
+    rb_nativethread_lock_destroy(&store->pool.shards[i].lock);
+#endif
+  HASH_ITER(hh, store->plural_rules, rule, tmp) {
+    HASH_DEL(store->plural_rules, rule);
+    xfree(rule->locale);
+    xfree(rule);
   }
-  return i_object_to_robject(key_frd);
+  xfree(store);
 }
 
+#ifndef RUBY_TYPED_FROZEN_SHAREABLE
+#define RUBY_TYPED_FROZEN_SHAREABLE 0
+#endif
+
+// shareable since nothing changes a frozen store (see freeze_translations)
+static const rb_data_type_t i_translations_type = {
+  "I18nema::Translations",
+  {mark_translations, delete_translations, memsize_translations},
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
+};
+
+static const rb_data_type_t i_key_cache_type = {
+  "I18nema::KeyCache",
+  {0, delete_key_cache, memsize_key_cache},
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 static VALUE
 initialize(VALUE self)
 {
   VALUE translations, key_cache;
 
-  i_object_t *root_object = new_hash_object();
-  translations = Data_Wrap_Struct(I18nemaBackend, 0, delete_object_r, root_object);
+  i_translations_t *store = ALLOC(i_translations_t);
+  store->root.type = i_type_hash;
+  store->root.data.hash = NULL;
+  store->arenas = NULL;
+  store->snapshot = NULL;
+  memset(&store->index, 0, sizeof(i_path_index_t));
+  memset(&store->profile, 0, sizeof(i_key_profile_t));
+  memset(&store->string_cache, 0, sizeof(i_string_cache_t));
+  init_string_pool(&store->pool);
+  store->plural_rules = NULL;
+  store->ruby_plurals = 0;
+  store->sources = NULL;
+  store->last_source = &store->sources;
+  store->spine = NULL;
+  store->incremental = 1;
+  store->keep_sources = 0;
+  store->generation = 0;
+  store->resolve_links = 0;
+  store->links_stale = 1;
+  store->frozen = 0;
+  store->cold_locales = NULL;
+  store->cold_spine = NULL;
+  store->idle_round = 0;
+  translations = TypedData_Wrap_Struct(rb_cObject, &i_translations_type, store);
   rb_iv_set(self, "@translations", translations);
 
-  i_object_t *key_map = new_hash_object();
-  key_cache = Data_Wrap_Struct(I18nemaBackend, 0, delete_object_r, key_map);
+  key_cache = new_key_cache(I_KEY_CACHE_MAX_ENTRIES, 0);
   rb_iv_set(self, "@normalized_key_cache", key_cache);
+  rb_ivar_set(self, s_pending_locales, Qnil);
 
   return self;
 }
@@ -587,6 +6987,21 @@ Init_i18nema()
   s_to_f = rb_intern("to_f");
   s_to_s = rb_intern("to_s");
   s_to_sym = rb_intern("to_sym");
+  s_call = rb_intern("call");
+  s_interpolate = rb_intern("interpolate");
+  s_load_yml = rb_intern("load_yml");
+  s_join = rb_intern("join");
+  s_alive_p = rb_intern("alive?");
+  s_load_locale = rb_intern("load_locale");
+  s_pending_locales = rb_intern("@pending_locales");
+  rb_global_variable(&reserved_keys);
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+  ractor_key_cache = rb_ractor_local_storage_value_newkey();
+#endif
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  // only frozen backends are shareable, and nothing changes those
+  rb_ext_ractor_safe(true);
+#endif
 
   i_object_null.type = i_type_null;
   i_object_true.type = i_type_true;
@@ -594,8 +7009,45 @@ Init_i18nema()
 
   rb_define_method(I18nemaBackend, "initialize", initialize, 0);
   rb_define_method(I18nemaBackend, "load_yml_string", load_yml_string, 1);
+  rb_define_method(I18nemaBackend, "load_hash", load_hash, 2);
+  rb_define_method(I18nemaBackend, "load_yml_file", load_yml_file, -1);
+  rb_define_method(I18nemaBackend, "parallel_load_yml_files", parallel_load_yml_files, 2);
   rb_define_method(I18nemaBackend, "available_locales", available_locales, 0);
   rb_define_method(I18nemaBackend, "reload!", reload, 0);
+  rb_define_method(I18nemaBackend, "reload_changed_sources", reload_changed_sources, 0);
+  rb_define_method(I18nemaBackend, "source_paths", source_paths, 0);
+  rb_define_method(I18nemaBackend, "arena_usage", arena_usage, 0);
+  rb_define_method(I18nemaBackend, "stats", stats, 0);
+  rb_define_method(I18nemaBackend, "write_snapshot", write_snapshot, 2);
+  rb_define_method(I18nemaBackend, "read_snapshot", read_snapshot, 2);
   rb_define_method(I18nemaBackend, "direct_lookup", direct_lookup, -1);
+  rb_define_method(I18nemaBackend, "dump_json", dump_json, 3);
+  rb_define_method(I18nemaBackend, "native_lookup", native_lookup, -1);
+  rb_define_method(I18nemaBackend, "native_lookup_many", native_lookup_many, 4);
+  rb_define_method(I18nemaBackend, "fallback_lookup", fallback_lookup, -1);
+  rb_define_method(I18nemaBackend, "path_index=", set_path_index, 1);
+  rb_define_method(I18nemaBackend, "path_index?", path_index_p, 0);
+  rb_define_method(I18nemaBackend, "resolve_links=", set_resolve_links, 1);
+  rb_define_method(I18nemaBackend, "resolve_links?", resolve_links_p, 0);
+  rb_define_method(I18nemaBackend, "freeze_translations", freeze_translations, 0);
+  rb_define_method(I18nemaBackend, "key_profile_rate=", set_key_profile_rate, 1);
+  rb_define_method(I18nemaBackend, "key_profile_data", key_profile_data, 0);
+  rb_define_method(I18nemaBackend, "frozen_strings=", set_frozen_strings, 1);
+  rb_define_method(I18nemaBackend, "frozen_strings?", frozen_strings_p, 0);
+  rb_define_method(I18nemaBackend, "string_pool=", set_string_pool, 1);
+  rb_define_method(I18nemaBackend, "string_pool?", string_pool_p, 0);
+  rb_define_method(I18nemaBackend, "keep_sources=", set_keep_sources, 1);
+  rb_define_method(I18nemaBackend, "keep_sources?", keep_sources_p, 0);
+  rb_define_method(I18nemaBackend, "deflate_locales", deflate_locales, 1);
+  rb_define_method(I18nemaBackend, "compress_idle_locales", compress_idle_locales, 0);
+  rb_define_method(I18nemaBackend, "locale_sizes", locale_sizes, 0);
   rb_define_method(I18nemaBackend, "normalize_key", normalize_key, 2);
+  rb_define_method(I18nemaBackend, "key_cache_max_entries=", set_key_cache_max_entries, 1);
+  rb_define_method(I18nemaBackend, "key_cache_max_bytes=", set_key_cache_max_bytes, 1);
+  rb_define_method(I18nemaBackend, "key_cache_stats", key_cache_stats, 0);
+  rb_define_method(I18nemaBackend, "prewarm_key_cache", prewarm_key_cache, 2);
+  rb_define_method(I18nemaBackend, "key_cache_keys", key_cache_keys, 0);
+  rb_define_method(I18nemaBackend, "plural_rule", set_plural_rule, 2);
+  rb_define_method(I18nemaBackend, "plural_key", plural_key, 2);
+  rb_define_method(I18nemaBackend, "ruby_plurals=", set_ruby_plurals, 1);
 }
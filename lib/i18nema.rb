@@ -1,32 +1,83 @@
 require 'yaml' if RUBY_VERSION >= "2.0" # otherwise syck asplodes
 require 'syck'
 require 'i18n'
-require File.dirname(__FILE__) + '/i18nema/core_ext/hash'
+require 'digest/sha1'
+require 'etc'
+require 'json'
 require File.dirname(__FILE__) + '/i18nema/i18nema'
 
 module I18nema
   module CoreMethods
-    RESERVED_KEY_MAP = Hash[I18n::RESERVED_KEYS.map{|k|[k,true]}]
+    RESERVED_KEY_MAP = Hash[I18n::RESERVED_KEYS.map{|k|[k,true]}].freeze
 
     def translate(locale, key, options = {})
       raise I18n::InvalidLocale.new(locale) unless locale
-      entry = key && lookup(locale, key, options[:scope], options)
 
       if options.empty?
+        entry = key && lookup(locale, key, options[:scope], options)
         entry = resolve(locale, key, entry, options)
       else
         count, default = options.values_at(:count, :default)
         # significant speedup over Hash#except
         values = options.reject { |key, value| RESERVED_KEY_MAP.key?(key) }
+        if values.empty?
+          entry = key && lookup(locale, key, options[:scope], options)
+        else
+          # the plural branch gets picked and String entries interpolated
+          # in C, so we're done with those
+          entry = key && lookup_entry(locale, key, options[:scope], options, values, count)
+          return entry if entry.is_a?(String)
+        end
         entry = entry.nil? && default ?
           default(locale, key, default, options) : resolve(locale, key, entry, options)
       end
 
       throw(:exception, I18n::MissingTranslation.new(locale, key, options)) if entry.nil?
-      # no need to dup, since I18nema gives us a new string
+      # no need to dup; I18nema either gives us a new string, or (with
+      # frozen_strings) a frozen one that we only replace if we change it
 
       entry = pluralize(locale, entry, count) if count
-      entry = interpolate(locale, entry, values) if values
+      entry = interpolate(locale, entry, values) if values && interpolatable?(entry)
+      entry
+    end
+
+  protected
+    def interpolatable?(entry)
+      !entry.is_a?(String) || entry.include?("%")
+    end
+
+    # same as I18n's, but with the plural rules of this backend (see
+    # plural_rule)
+    def pluralize(locale, entry, count)
+      return entry unless entry.is_a?(Hash) && count
+
+      key = :zero if count == 0 && entry.has_key?(:zero)
+      key ||= plural_key(locale, count)
+      raise I18n::InvalidPluralizationData.new(entry, count) unless entry.has_key?(key)
+      entry[key]
+    end
+  end
+
+  # Include this after I18n::Backend::Fallbacks, and the fallback chain
+  # gets probed in a single native call (see fallback_lookup), rather
+  # than a translate per locale. Anything it can't settle on its own
+  # (defaults, Procs, Hashes, misses) goes through Fallbacks as usual.
+  module Fallbacks
+    def translate(locale, key, options = {})
+      return super if locale.nil? || key.nil? || options[:fallback_in_progress] ||
+                      options.key?(:default) || options[:fallback] == false || options[:resolve] == false
+      init_translations unless initialized?
+      values = options.reject { |key, value| CoreMethods::RESERVED_KEY_MAP.key?(key) }
+      locales = I18n.fallbacks[locale]
+      separator = options[:separator] || I18n.default_separator
+      check_pluralize if options[:count]
+      entry, found = values.empty? ?
+        fallback_lookup(locales, key, options[:scope], separator) :
+        fallback_lookup(locales, key, options[:scope], separator, values, options[:count])
+      # Strings are final (see CoreMethods#translate), anything else
+      # needs resolving in Ruby
+      return super unless entry.is_a?(String)
+      on_fallback(locale, found, key, options) if found.to_s != locale.to_s && respond_to?(:on_fallback, true)
       entry
     end
   end
@@ -35,18 +86,264 @@ module I18nema
     include I18n::Backend::Base
     include CoreMethods # defined in a module so that other modules (e.g. I18n::Backend::Fallbacks) can override them
 
+    protected :write_snapshot, :read_snapshot, :plural_key, :parallel_load_yml_files,
+              :load_yml_file, :reload_changed_sources, :source_paths,
+              :prewarm_key_cache, :key_cache_keys, :dump_json,
+              :freeze_translations, :key_profile_data, :deflate_locales,
+              :ruby_plurals=
+
+    # When true, init_translations only indexes which locales each yml
+    # file has, and a locale's files get parsed the first time it's
+    # looked up (or when you preload_locales)
+    attr_accessor :lazy_locales
+
     def store_translations(locale, data, options = {})
-      # TODO: make this moar awesome
       @initialized = true
-      load_yml_string({locale => data}.deep_stringify_keys.to_yaml)
+      # so the file translations don't override these when they get loaded
+      load_locale(locale.to_s) if @pending_locales
+      load_hash(locale, data)
     end
 
     def init_translations
+      if lazy_locales
+        @pending_locales = {}
+        @loaded_locales = {}
+        @locale_mutex = Mutex.new
+      end
       load_translations
       @initialized = true
     end
 
+    # Loads the given locales now rather than on first use, e.g. before
+    # forking, so that workers share them
+    def preload_locales(locales)
+      init_translations unless initialized?
+      locales.each { |locale| load_locale(locale.to_s) }
+    end
+
+    # yml files get read and parsed in parallel (see load_yml_files),
+    # anything else is loaded one file at a time as usual
+    def load_translations(*filenames)
+      filenames = I18n.load_path if filenames.empty?
+      filenames = filenames.flatten.map(&:to_s)
+      if @pending_locales
+        index_locales(filenames)
+      elsif filenames.all? { |filename| File.extname(filename).downcase == ".yml" }
+        load_yml_files(filenames)
+      else
+        super
+      end
+    end
+
+    # Same as calling load_yml on each file in turn, except that they're
+    # read and parsed on up to options[:threads] native threads (default:
+    # one per processor) without holding the GVL
+    def load_yml_files(paths, options = {})
+      threads = options[:threads] || (Etc.respond_to?(:nprocessors) ? Etc.nprocessors : 1)
+      parallel_load_yml_files(paths.flatten.map(&:to_s), threads)
+    end
+
+    # Unlike reload!, only re-parses the yml files that have changed (plus
+    # any that share a locale's top level keys with them), and swaps out
+    # just the affected subtrees. Deleted files get dropped, and files that
+    # have been added to I18n.load_path since get loaded. Returns the number of files
+    # (re)loaded, or nil if everything had to be reload!ed (as is the case
+    # with snapshots).
+    def reload_changed!
+      return 0 unless initialized?
+      count = reload_changed_sources
+      unless count
+        reload!
+        return nil
+      end
+      known_files = source_paths
+      known_files += @pending_locales.values.flatten if @pending_locales
+      new_files = (I18n.load_path.flatten.map(&:to_s) - known_files).select { |file| File.exist?(file) }
+      load_translations(new_files) if new_files.any?
+      count + new_files.size
+    end
+
+    # Looks up each of keys (under locale and options[:scope]) in a single
+    # native call, e.g. for a form's labels or a table's column headers.
+    # Returns what lookup would for each, in the same order (nil for any
+    # that are missing); defaults, interpolation etc. are up to you.
+    #
+    #   I18n.backend.lookup_many(:en, [:name, :email], scope: [:activerecord, :attributes, :user])
+    def lookup_many(locale, keys, options = {})
+      init_translations unless initialized?
+      native_lookup_many(locale, keys.to_a, options[:scope], options[:separator] || I18n.default_separator)
+    end
+
+    # Caches the normalized form of each of keys up front, e.g. in a
+    # preforking server's master, so that workers don't each build (and
+    # dirty) their own copy of the cache during their first requests
+    def prewarm(keys, separator = I18n.default_separator)
+      prewarm_key_cache(keys.to_a, separator.to_s)
+    end
+
+    # Writes every key in the normalized key cache to path, e.g. from a
+    # process that has been serving traffic for a while, for
+    # load_key_cache to prewarm with later
+    def dump_key_cache(path)
+      File.open(path, "w") { |file| file.write(JSON.generate(key_cache_keys)) }
+    end
+
+    def load_key_cache(path)
+      JSON.parse(File.read(path)).each do |separator, keys|
+        prewarm(keys["strings"] + keys["symbols"].map(&:to_sym), separator)
+      end
+    end
+
+    # Serializes the translations under locale (and scope, if given) to
+    # JSON directly from the C tree, e.g. for client-side bundles. With
+    # :only, just those keys of it are included. Returns nil if there's
+    # nothing there.
+    #
+    #   export_json(:en, :js, only: [:errors, :dates])
+    def export_json(locale, *args)
+      options = args.last.is_a?(Hash) ? args.pop : {}
+      init_translations unless initialized?
+      dump_json(json_scope(locale, args), json_only(options), nil)
+    end
+
+    # Same as export_json, but writes to io in chunks as it goes (for very
+    # large locales) and returns the number of bytes written
+    def export_json_to(io, locale, *args)
+      options = args.last.is_a?(Hash) ? args.pop : {}
+      init_translations unless initialized?
+      dump_json(json_scope(locale, args), json_only(options), io)
+    end
+
+    # What the lookups sampled since key_profile_rate was set have seen:
+    # the (options[:top], default 20) most looked up keys, all the keys
+    # that were never looked up, and the most common keys that were
+    # looked up but missing. Counts are of sampled lookups only.
+    #
+    #   backend.key_profile_rate = 100
+    #   backend.key_profile(top: 50)  # => {hot: [["en.foo", 1200], ...], dead: ["en.bar", ...], missing: [...], ...}
+    def key_profile(options = {})
+      top = options[:top] || 20
+      profile = key_profile_data
+      profile[:hot] = profile[:hot].sort_by { |key, count| -count }.first(top)
+      profile[:missing] = profile[:missing].sort_by { |key, count| -count }.first(top)
+      profile[:dead].sort!
+      profile
+    end
+
+    # Loads everything (including any lazy locales) and makes the backend
+    # immutable, and on rubies with Ractors, shareable between them. Each
+    # Ractor gets its own key cache, and lookups don't contend on
+    # anything. Loading or storing translations afterwards raises
+    # FrozenError.
+    #
+    #   I18n.backend.freeze!
+    #   Ractor.new(I18n.backend) { |backend| backend.translate(:en, :hello) }
+    def freeze!
+      init_translations unless initialized?
+      load_locale(nil) if @pending_locales
+      @pending_locales = @locale_mutex = nil
+      check_pluralize
+      freeze_translations
+      defined?(Ractor) ? Ractor.make_shareable(self) : freeze
+    end
+
+    # Swaps the given locales' translations for a deflated copy, e.g. for
+    # the locales that hardly get any traffic. A locale gets inflated
+    # again on its next lookup. The memory only goes back if every locale
+    # in a file is compressed, so this works best with a file (or a few)
+    # per locale. Returns the number of locales compressed.
+    #
+    #   I18n.backend.compress_locales(:de, :"pt-BR")
+    def compress_locales(*locales)
+      init_translations unless initialized?
+      deflate_locales(locales.flatten.map(&:to_s))
+    end
+
+    # Writes the merged translations to a binary snapshot that
+    # load_snapshot can mmap later on, e.g. in other processes
+    def dump_snapshot(path)
+      init_translations unless initialized?
+      load_locale(nil) if @pending_locales
+      write_snapshot(path, snapshot_fingerprint)
+    end
+
+    # Uses the snapshot at path for all translations. Returns false if it
+    # is stale (i.e. the contents of I18n.load_path have changed since it
+    # was dumped), in which case you should load translations normally.
+    def load_snapshot(path)
+      return false unless read_snapshot(path, snapshot_fingerprint)
+      @pending_locales = nil
+      @initialized = true
+    end
+
   protected
+    def json_scope(locale, scope)
+      [locale.to_s].concat(scope.flatten.map { |part| part.to_s.split(I18n.default_separator) }.flatten)
+    end
+
+    def json_only(options)
+      options[:only] && Array(options[:only]).map(&:to_s)
+    end
+
+    LOCALE_LINE = /\A(["']?)([\w\-]+)\1:(\s|\z)/
+
+    # Records which files have which (top level) locales, without parsing
+    # them. Files for locales that are already loaded get loaded right
+    # away, as does anything that isn't yml or doesn't look like it has
+    # locales at the top
+    def index_locales(filenames)
+      filenames.each do |filename|
+        locales = File.extname(filename).downcase == ".yml" ? top_level_locales(filename) : []
+        if locales.empty?
+          load_file(filename)
+          next
+        end
+        locales.each do |locale|
+          if @loaded_locales[locale]
+            load_yml_file(filename, locale)
+          else
+            (@pending_locales[locale] ||= []) << filename
+          end
+        end
+      end
+    end
+
+    def top_level_locales(filename)
+      locales = []
+      File.foreach(filename) do |line|
+        locales << $2 if line =~ LOCALE_LINE
+      end
+      locales.uniq
+    end
+
+    # Parses the pending files for locale, keeping only that locale's
+    # translations from each. Called from C on the first lookup of a
+    # pending locale; nil loads them all. A locale stays pending until all
+    # its files are loaded, so if one raises, the next lookup carries on
+    # where this one left off.
+    def load_locale(locale)
+      @locale_mutex.synchronize do
+        (locale.nil? ? @pending_locales.keys : [locale]).each do |pending|
+          files = @pending_locales[pending] || []
+          until files.empty?
+            load_yml_file(files.first, pending)
+            files.shift
+          end
+          @pending_locales.delete(pending)
+          @loaded_locales[pending] = true
+        end
+      end
+    end
+
+    # based on file contents rather than paths/mtimes, so that a snapshot
+    # stays valid across checkouts/deploys of the same translations
+    def snapshot_fingerprint
+      digests = I18n.load_path.flatten.map do |filename|
+        File.exist?(filename) ? Digest::SHA1.file(filename).hexdigest : "-"
+      end
+      Digest::SHA1.hexdigest(digests.join(","))
+    end
+
     def load_file(filename)
       type = File.extname(filename).tr('.', '').downcase
       raise I18n::UnknownFileType.new(type, filename) unless type == "yml"
@@ -54,7 +351,7 @@ module I18nema
     end
 
     def load_yml(filename)
-      load_yml_string File.read(filename)
+      load_yml_file filename
     end
 
     def initialized?
@@ -63,8 +360,32 @@ module I18nema
 
     def lookup(locale, key, scope = [], options = {})
       init_translations unless initialized?
-      keys = normalize_keys(locale, key, scope, options[:separator])
-      direct_lookup(*keys)
+      # native_lookup would follow symbol links
+      if options[:resolve] == false && resolve_links?
+        return direct_lookup(*normalize_keys(locale, key, scope, options[:separator]))
+      end
+      native_lookup(locale, key, scope, options[:separator] || I18n.default_separator)
+    end
+
+    # like lookup, but (in C) picks the plural branch for count and
+    # interpolates String entries with values, via the templates
+    # precompiled when they were loaded
+    def lookup_entry(locale, key, scope, options, values, count = nil)
+      init_translations unless initialized?
+      if options[:resolve] == false && resolve_links?
+        entry = lookup(locale, key, scope, options)
+        return entry if entry.is_a?(Symbol)
+      end
+      check_pluralize if count
+      native_lookup(locale, key, scope, options[:separator] || I18n.default_separator, values, count)
+    end
+
+    # Lookups pick plural branches with this backend's plural rules, which
+    # would bypass an overridden pluralize (e.g. I18n::Backend::Pluralization),
+    # so in that case only locales with a plural_rule get picked in C
+    def check_pluralize
+      return if defined?(@ruby_plurals)
+      self.ruby_plurals = @ruby_plurals = method(:pluralize).owner != CoreMethods
     end
 
     def normalize_keys(locale, key, scope, separator = nil)
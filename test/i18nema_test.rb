@@ -1,5 +1,6 @@
 require 'helper'
 require 'yaml'
+require 'tmpdir'
 
 class I18nemaTest < Test::Unit::TestCase
   def setup
@@ -38,6 +39,580 @@ class I18nemaTest < Test::Unit::TestCase
                  @backend.direct_lookup("poo")
   end
 
+  def test_native_lookup
+    assert_equal "lol",
+                 @backend.native_lookup(:en, "foo.bar", nil, ".")
+    assert_equal "lol",
+                 @backend.native_lookup("en", :bar, [:foo], ".")
+    assert_equal "lol",
+                 @backend.native_lookup(:en, [:foo, "bar"], [], ".")
+    assert_equal "lol",
+                 @backend.native_lookup(:en, "bar", "..foo.", ".")
+    assert_equal "lol",
+                 @backend.native_lookup(:en, "foo|bar", nil, "|")
+    assert_equal({bar: "lol"},
+                 @backend.native_lookup(:en, :foo, nil, "."))
+    assert_equal nil,
+                 @backend.native_lookup(:en, "foo.bar.baz", nil, ".")
+    long_key = (["foo"] * 20).join(".")
+    assert_equal nil,
+                 @backend.native_lookup(:en, long_key, nil, ".")
+
+    @backend.path_index = true
+    assert_equal "lol",
+                 @backend.native_lookup(:en, "bar", :foo, ".")
+  end
+
+  def test_interpolation
+    @backend.store_translations :en, greeting: "hi %{name}, 100%% %<pct>.1f%",
+                                     escaped: "%%{scope}", plain: "hi"
+    assert_equal "hi bob, 100% 99.5%",
+                 @backend.translate(:en, "greeting", name: "bob", pct: 99.5)
+    assert_equal "hi BOB, 100% 1.0%",
+                 @backend.translate(:en, "greeting", name: ->(values) { "BOB" }, pct: 1)
+    assert_equal "hi", @backend.translate(:en, "plain", name: "bob")
+    assert_raise(I18n::MissingInterpolationArgument) { @backend.translate(:en, "greeting", name: "bob") }
+    assert_raise(I18n::ReservedInterpolationKey) { @backend.translate(:en, "escaped", name: "bob") }
+    assert_equal "hi bob, 100% 99.5%",
+                 @backend.native_lookup(:en, "greeting", nil, ".", name: "bob", pct: 99.5)
+  end
+
+  def test_pluralization
+    @backend.store_translations :en, apples: {zero: "no apples", one: "an apple", other: "%{count} apples"}
+    @backend.store_translations :ru, apples: {one: "%{count} yabloko", few: "%{count} yabloka", many: "%{count} yablok"}
+    assert_equal "no apples", @backend.translate(:en, "apples", count: 0)
+    assert_equal "an apple", @backend.translate(:en, "apples", count: 1)
+    assert_equal "3 apples", @backend.translate(:en, "apples", count: 3)
+    assert_equal "an apple", @backend.native_lookup(:en, "apples", nil, ".", nil, 1)
+
+    assert_raise(I18n::InvalidPluralizationData) { @backend.translate(:ru, "apples", count: 3) }
+    @backend.plural_rule :ru, :east_slavic
+    assert_equal "21 yabloko", @backend.translate(:ru, "apples", count: 21)
+    assert_equal "3 yabloka", @backend.translate(:ru, "apples", count: 3)
+    assert_equal "11 yablok", @backend.translate(:ru, "apples", count: 11)
+    assert_equal "#{10**30} yablok", @backend.translate(:ru, "apples", count: 10**30)
+    assert_raise(I18n::InvalidPluralizationData) { @backend.translate(:ru, "apples", count: Float::INFINITY) }
+    assert_raise(I18n::InvalidPluralizationData) { @backend.translate(:ru, "apples", count: Float::NAN) }
+
+    @backend.plural_rule :en, ->(count) { count > 1 ? :other : :one }
+    assert_equal "an apple", @backend.translate(:en, "apples", count: -1)
+    assert_raise(ArgumentError) { @backend.plural_rule :en, :klingon }
+  end
+
+  def test_pluralization_module
+    backend = Class.new(I18nema::Backend) do
+      include I18n::Backend::Pluralization
+      # i18n.plural.rule would be a Proc, which we can't store
+      def pluralizer(locale)
+        ->(n) { n % 10 == 1 && n % 100 != 11 ? :one : (2..4).include?(n % 10) && !(12..14).include?(n % 100) ? :few : :many } if locale.to_s == "ru"
+      end
+    end.new
+    backend.store_translations :en, apples: {one: "an apple", other: "%{count} apples"}
+    backend.store_translations :ru, apples: {one: "%{count} yabloko", few: "%{count} yabloka", many: "%{count} yablok"}
+    assert_equal "3 yabloka", backend.translate(:ru, "apples", count: 3)
+    assert_equal "11 yablok", backend.translate(:ru, "apples", count: 11)
+    assert_equal "3 apples", backend.translate(:en, "apples", count: 3)
+    assert_equal({one: "%{count} yabloko", few: "%{count} yabloka", many: "%{count} yablok"},
+                 backend.native_lookup(:ru, "apples", nil, ".", {count: 3}, 3))
+
+    # a native rule still wins for its locale
+    backend.plural_rule :ru, ->(n) { :one }
+    assert_equal "3 yabloko", backend.native_lookup(:ru, "apples", nil, ".", {count: 3}, 3)
+  end
+
+  def test_fallback_lookup
+    @backend.store_translations :fr, foo: {bar: "mdr"}, apples: {one: "%{count} pomme", other: "%{count} pommes"}
+    @backend.store_translations :"fr-CA", foo: {bar: nil}
+    assert_equal ["mdr", :fr],
+                 @backend.fallback_lookup([:"fr-CA", :fr, :en], "foo.bar", nil, ".")
+    assert_equal ["lol", "en"],
+                 @backend.fallback_lookup(["de", "en"], :bar, [:foo], ".")
+    assert_equal ["2 pommes", :fr],
+                 @backend.fallback_lookup([:"fr-CA", :fr], "apples", nil, ".", {count: 2}, 2)
+    assert_nil @backend.fallback_lookup([:"fr-CA", :fr], "foo.baz", nil, ".")
+    assert_nil @backend.fallback_lookup([], "foo.bar", nil, ".")
+  end
+
+  def test_lookup_many
+    @backend.store_translations :en, foo: {baz: {qux: "deep"}, link: :"foo.bar"}
+    @backend.resolve_links = true
+    assert_equal ["lol", nil, "deep", "deep", {qux: "deep"}],
+                 @backend.lookup_many(:en, [:bar, :nope, "baz.qux", [:baz, :qux], :baz], scope: :foo)
+    assert_equal ["lol", ["asdf", "qwerty"], "lol"], @backend.lookup_many("en", ["foo.bar", :baz, "foo.link"])
+    assert_equal ["lol"], @backend.lookup_many(:en, ["foo|bar"], separator: "|")
+    assert_equal [nil, nil], @backend.lookup_many(:en, [:bar, :baz], scope: "nope.nope")
+    assert_equal [], @backend.lookup_many(:en, [])
+
+    @backend.path_index = true
+    assert_equal ["lol", "deep"], @backend.lookup_many(:en, [:bar, "baz.qux"], scope: [:foo])
+
+    path = File.join(Dir.tmpdir, "i18nema_test_#{$$}.snapshot")
+    @backend.dump_snapshot(path)
+    backend = I18nema::Backend.new
+    assert backend.load_snapshot(path)
+    assert_equal ["lol", "deep", nil, {qux: "deep"}, {bar: "lol", baz: {qux: "deep"}, link: :"foo.bar"}],
+                 backend.native_lookup_many(:en, [:bar, "baz.qux", :lol, :baz, []], [:foo], ".")
+  ensure
+    File.unlink(path) if path && File.exist?(path)
+  end
+
+  def test_resolve_links
+    @backend.store_translations :en, link: :"foo.bar", chain: :link, loop: :loop2, loop2: :loop,
+                                     broken: :nope, scoped: {bar: :bar}
+    assert_equal :"foo.bar", @backend.translate(:en, "link", resolve: false)
+    @backend.resolve_links = true
+    assert @backend.resolve_links?
+    assert_equal "lol", @backend.native_lookup(:en, "link", nil, ".")
+    assert_equal "lol", @backend.native_lookup(:en, "chain", nil, ".")
+    assert_equal :loop2, @backend.native_lookup(:en, "loop", nil, ".")
+    assert_equal :nope, @backend.native_lookup(:en, "broken", nil, ".")
+    # relative to the scope, so that's up to I18n
+    assert_equal :bar, @backend.native_lookup(:en, "bar", [:scoped], ".")
+    assert_equal :"foo.bar", @backend.translate(:en, "link", resolve: false)
+
+    @backend.store_translations :en, foo: {bar: "rofl"}
+    assert_equal "rofl", @backend.translate(:en, "chain")
+  end
+
+  def test_freeze
+    @backend.store_translations :en, greeting: "hi %{name}"
+    @backend.path_index = true
+    @backend.frozen_strings = true
+    @backend.freeze!
+    assert @backend.frozen?
+    assert_equal "lol", @backend.native_lookup(:en, "foo.bar", nil, ".")
+    assert_equal "lol", @backend.translate(:en, "foo.bar")
+    assert_raise(FrozenError) { @backend.load_yml_string("en:\n  foo: bar") }
+    assert_raise(FrozenError) { @backend.store_translations :en, foo: "bar" }
+    assert_raise(FrozenError) { @backend.reload! }
+
+    # dumping doesn't touch the store, snapshot-backed or not
+    path = File.join(Dir.tmpdir, "i18nema_test_#{$$}.snapshot")
+    @backend.dump_snapshot(path)
+    mapped = I18nema::Backend.new
+    assert mapped.load_snapshot(path)
+    mapped.freeze!
+    mapped.dump_snapshot(path)
+    assert_equal 0, mapped.arena_usage[:arenas]
+    assert_equal "hi bob", mapped.translate(:en, "greeting", name: "bob")
+    assert_equal "lol", @backend.translate(:en, "foo.bar")
+    return unless defined?(Ractor)
+
+    assert Ractor.shareable?(@backend)
+    experimental, Warning[:experimental] = Warning[:experimental], false
+    ractors = Array.new(2) do
+      Ractor.new(@backend) do |backend|
+        Array.new(100) { [backend.native_lookup(:en, "foo.bar", nil, "."), backend.native_lookup(:en, "greeting", nil, ".", {name: "bob"})] }.uniq
+      end
+    end
+    assert_equal [[["lol", "hi bob"]], [["lol", "hi bob"]]], ractors.map(&:take)
+  ensure
+    Warning[:experimental] = experimental if experimental
+    File.unlink(path) if path && File.exist?(path)
+  end
+
+  def test_key_profile
+    @backend.store_translations :en, baz: {qux: "a", quux: "b"}, unused: "c"
+    @backend.key_profile_rate = 1
+    3.times { @backend.translate(:en, "foo.bar") }
+    @backend.translate(:en, "baz")
+    2.times { @backend.native_lookup(:en, "nope", nil, ".") }
+    @backend.direct_lookup("en", "missing", "too")
+
+    profile = @backend.key_profile(top: 1)
+    assert_equal 1, profile[:sample_rate]
+    assert_equal 7, profile[:samples]
+    assert_equal [["en.foo.bar", 3]], profile[:hot]
+    assert_equal ["en.stuff", "en.unused"], profile[:dead]
+    assert_equal [["en.nope", 2]], profile[:missing]
+    assert_equal 2, @backend.key_profile[:missing].size
+
+    @backend.key_profile_rate = 2
+    4.times { @backend.translate(:en, "foo.bar") }
+    assert_equal [["en.foo.bar", 2]], @backend.key_profile[:hot]
+    @backend.key_profile_rate = nil
+    @backend.translate(:en, "foo.bar")
+    assert_equal 0, @backend.key_profile[:samples]
+  end
+
+  def test_key_cache
+    backend = I18nema::Backend.new
+    backend.store_translations :en, @data
+    backend.key_cache_max_entries = 2
+    assert_equal "lol", backend.native_lookup(:en, :"foo.bar", nil, ".")
+    assert_equal "lol", backend.native_lookup(:en, :"foo.bar", nil, ".")
+    assert_equal "lol", backend.native_lookup(:en, "foo.bar", nil, ".")
+    stats = backend.key_cache_stats
+    assert_equal [2, 1, 2, 0], stats.values_at(:entries, :hits, :misses, :evictions)
+
+    backend.native_lookup(:en, "baz", nil, ".")
+    backend.native_lookup(:en, "stuff", nil, ".")
+    stats = backend.key_cache_stats
+    assert_equal [2, 2], stats.values_at(:entries, :evictions)
+    assert_equal "lol", backend.native_lookup(:en, :"foo.bar", nil, ".")
+
+    backend.key_cache_max_entries = nil
+    backend.key_cache_max_bytes = 1
+    assert_equal 0, backend.key_cache_stats[:entries]
+    assert_equal %w{foo bar}, backend.normalize_key(:"foo.bar", ".")
+    assert_raise(ArgumentError) { backend.key_cache_max_bytes = -1 }
+  end
+
+  def test_prewarm_key_cache
+    path = File.join(Dir.tmpdir, "i18nema_test_#{$$}.keys")
+    @backend.native_lookup(:en, :"foo.bar", nil, ".")
+    @backend.native_lookup(:en, "baz", nil, ".")
+    @backend.native_lookup(:en, "foo|bar", nil, "|")
+    @backend.dump_key_cache(path)
+
+    backend = I18nema::Backend.new
+    backend.store_translations :en, @data
+    backend.load_key_cache(path)
+    backend.prewarm [[:stuff, "x"]]
+    assert_equal [5, 0, 0], backend.key_cache_stats.values_at(:entries, :hits, :misses)
+    assert_equal "lol", backend.native_lookup(:en, :"foo.bar", nil, ".")
+    assert_equal "lol", backend.native_lookup(:en, "foo|bar", nil, "|")
+    assert_equal [5, 2, 0], backend.key_cache_stats.values_at(:entries, :hits, :misses)
+  ensure
+    File.unlink(path) if path && File.exist?(path)
+  end
+
+  def test_path_index
+    @backend.path_index = true
+    assert @backend.path_index?
+    assert_equal "lol",
+                 @backend.direct_lookup("en", "foo", "bar")
+    assert_equal({bar: "lol"},
+                 @backend.direct_lookup("en", "foo"))
+    assert_equal nil,
+                 @backend.direct_lookup("en", "foo", "bar", "baz")
+    assert_equal nil,
+                 @backend.direct_lookup("en", "foobar")
+
+    @backend.store_translations :en, foo: {bar: "replaced!"}
+    assert_equal "replaced!",
+                 @backend.direct_lookup("en", "foo", "bar")
+
+    @backend.reload!
+    assert_equal nil,
+                 @backend.direct_lookup("en", "foo", "bar")
+  end
+
+  def test_frozen_strings
+    @backend.store_translations :en, greeting: "hi %{name}"
+    assert !@backend.direct_lookup("en", "foo", "bar").frozen?
+
+    @backend.frozen_strings = true
+    lol = @backend.direct_lookup("en", "foo", "bar")
+    assert lol.frozen?
+    assert_same lol, @backend.direct_lookup("en", "foo", "bar")
+    assert_same lol, @backend.direct_lookup("en", "foo")[:bar]
+    assert_same lol, @backend.translate(:en, "foo.bar")
+    assert_same lol, @backend.translate(:en, "foo.bar", name: "bob")
+
+    greeting = @backend.translate(:en, "greeting", name: "bob")
+    assert_equal "hi bob", greeting
+    assert !greeting.frozen?
+    assert_equal "hi %{name}", @backend.direct_lookup("en", "greeting")
+
+    # overwritten strings give their cache slots back
+    entries = @backend.stats[:string_cache][:entries]
+    10.times do |i|
+      @backend.store_translations :en, foo: {bar: "lol #{i}"}
+      assert_equal "lol #{i}", @backend.direct_lookup("en", "foo", "bar")
+    end
+    assert_equal entries, @backend.stats[:string_cache][:entries]
+    @backend.store_translations :en, foo: {bar: "lol"}
+    assert_equal({entries: entries - 1, free: 1}, @backend.stats[:string_cache])
+
+    @backend.reload!
+    @backend.store_translations :en, foo: {bar: "rofl"}
+    assert_equal "rofl", @backend.direct_lookup("en", "foo", "bar")
+    assert @backend.direct_lookup("en", "foo", "bar").frozen?
+  end
+
+  def test_string_pool
+    assert !@backend.stats.key?(:string_pool)
+    @backend.string_pool = true
+    assert @backend.string_pool?
+    @backend.load_yml_string("fr:\n  foo:\n    bar: lol\n  greeting: hi %{name}\n")
+    @backend.load_yml_string("de:\n  foo:\n    bar: lol\n  greeting: hi %{name}\n")
+
+    pool = @backend.stats[:string_pool]
+    assert_equal 7, pool[:strings] # fr, de, foo, bar, lol, greeting, hi %{name}
+    assert_equal 5, pool[:hits]
+    assert_equal 5.0 / 12, pool[:hit_rate]
+    assert pool[:bytes_saved] > "foobarlolgreetinghi %{name}".size
+    assert_equal "lol", @backend.direct_lookup("de", "foo", "bar")
+    assert_equal "hi bob", @backend.translate(:fr, "greeting", name: "bob")
+    assert_equal "hi bob", @backend.translate(:de, "greeting", name: "bob")
+    assert_equal 0, pool[:orphaned]
+    assert_equal 0, pool[:orphaned_bytes]
+
+    @backend.load_yml_string("fr:\n  greeting: salut %{name}\n")
+    pool = @backend.stats[:string_pool]
+    assert_equal 0, pool[:orphaned] # de still uses "hi %{name}"
+    @backend.load_yml_string("de:\n  greeting: hallo %{name}\n  foo: nope\n")
+    pool = @backend.stats[:string_pool]
+    assert_equal 1, pool[:orphaned] # hi %{name} (fr still has foo.bar)
+    assert pool[:orphaned_bytes] > "hi %{name}".size
+    assert_equal "hallo bob", @backend.translate(:de, "greeting", name: "bob")
+
+    @backend.reload!
+    assert_equal 0, @backend.stats[:string_pool][:strings]
+    assert_equal 0, @backend.stats[:string_pool][:orphaned_bytes]
+  end
+
+  def test_compress_locales
+    @backend.store_translations :de, foo: {bar: "lol", baz: "hi %{name}"}, list: [1, :sym, nil],
+                                     more: Hash[(1..500).map { |i| ["key#{i}", "value #{i}"] }]
+    allocated = @backend.arena_usage[:bytes_allocated]
+    assert_equal 1, @backend.compress_locales(:de, :nope)
+    assert @backend.arena_usage[:bytes_allocated] < allocated
+    sizes = @backend.locale_sizes
+    assert_equal 0, sizes[:de][:resident]
+    assert sizes[:de][:compressed] > 0
+    assert sizes[:en][:resident] > 0
+    assert_equal [:de, :en], @backend.available_locales.sort
+
+    assert_equal "hi bob", @backend.translate(:de, "foo.baz", name: "bob")
+    assert_equal [1, :sym, nil], @backend.direct_lookup("de", "list")
+    assert_nil @backend.locale_sizes[:de][:compressed]
+
+    @backend.compress_locales(:de)
+    @backend.store_translations :de, foo: {qux: "rofl"}
+    assert_equal({bar: "lol", baz: "hi %{name}", qux: "rofl"}, @backend.direct_lookup("de", "foo"))
+    assert_equal "value 500", @backend.direct_lookup("de", "more", "key500")
+
+    assert_equal [], @backend.compress_idle_locales
+    @backend.translate(:en, "foo.bar")
+    assert_equal [:de], @backend.compress_idle_locales
+    assert_equal [:en], @backend.compress_idle_locales
+    assert_equal({en: @data}, @backend.direct_lookup.select { |locale, _| locale == :en })
+  end
+
+  def test_snapshot
+    path = File.join(Dir.tmpdir, "i18nema_test_#{$$}.snapshot")
+    @backend.store_translations :es, foo: {bar: "jaja"}
+    @backend.dump_snapshot(path)
+
+    backend = I18nema::Backend.new
+    assert backend.load_snapshot(path)
+    assert_equal({en: @data, es: {foo: {bar: "jaja"}}}, backend.direct_lookup)
+    assert_equal "lol", backend.direct_lookup("en", "foo", "bar")
+    assert_equal nil, backend.direct_lookup("en", "foo", "bar", "baz")
+    assert_equal nil, backend.direct_lookup("fr")
+    assert_equal ['en', 'es'], backend.available_locales.map(&:to_s).sort
+
+    # dumping it again leaves it on the mapped snapshot
+    assert_equal 0, backend.arena_usage[:arenas]
+    copy_path = "#{path}.copy"
+    backend.dump_snapshot(copy_path)
+    assert_equal 0, backend.arena_usage[:arenas]
+    assert_equal "lol", backend.direct_lookup("en", "foo", "bar")
+    copy = I18nema::Backend.new
+    assert copy.load_snapshot(copy_path)
+    assert_equal({en: @data, es: {foo: {bar: "jaja"}}}, copy.direct_lookup)
+    backend.send(:write_snapshot, copy_path, "a longer fingerprint")
+    copy = I18nema::Backend.new
+    assert copy.send(:read_snapshot, copy_path, "a longer fingerprint")
+    assert_equal({en: @data, es: {foo: {bar: "jaja"}}}, copy.direct_lookup)
+
+    backend.frozen_strings = true
+    assert_same backend.direct_lookup("en", "foo", "bar"), backend.direct_lookup("en", "foo", "bar")
+
+    backend.store_translations :en, foo: {baz: "added!"}
+    assert_equal({bar: "lol", baz: "added!"}, backend.direct_lookup("en", "foo"))
+    assert_equal "jaja", backend.direct_lookup("es", "foo", "bar")
+
+    File.open(path, "r+b") { |f| f.seek(-2, IO::SEEK_END); f.write("!!") }
+    assert_raise(I18nema::Backend::LoadError) { backend.load_snapshot(path) }
+  ensure
+    File.unlink(path) if path && File.exist?(path)
+    File.unlink(copy_path) if copy_path && File.exist?(copy_path)
+  end
+
+  def test_corrupt_snapshot
+    path = File.join(Dir.tmpdir, "i18nema_test_#{$$}.snapshot")
+    @backend.dump_snapshot(path)
+    data = File.binread(path)
+    File.binwrite(path, data[0, 20])
+    assert_raise(I18nema::Backend::LoadError) { I18nema::Backend.new.load_snapshot(path) }
+
+    # a bad offset with a good checksum, i.e. the root's children are way off the end
+    nodes_offset = data[56, 8].unpack1("Q<")
+    data[nodes_offset + 8, 8] = [1 << 40].pack("q<")
+    data[24, 8] = [snapshot_checksum(data[80..-1])].pack("Q<")
+    File.binwrite(path, data)
+    assert_raise(I18nema::Backend::LoadError) { I18nema::Backend.new.load_snapshot(path) }
+  ensure
+    File.unlink(path) if path && File.exist?(path)
+  end
+
+  def test_stale_snapshot
+    path = File.join(Dir.tmpdir, "i18nema_test_#{$$}.snapshot")
+    yml = File.join(Dir.tmpdir, "i18nema_test_#{$$}.yml")
+    File.write(yml, "en:\n  foo: bar")
+    load_path = I18n.load_path
+    I18n.load_path = [yml]
+    I18nema::Backend.new.dump_snapshot(path)
+
+    backend = I18nema::Backend.new
+    assert backend.load_snapshot(path)
+    assert_equal "bar", backend.direct_lookup("en", "foo")
+
+    File.write(yml, "en:\n  foo: baz")
+    assert_equal false, I18nema::Backend.new.load_snapshot(path)
+  ensure
+    I18n.load_path = load_path
+    [path, yml].each { |file| File.unlink(file) if File.exist?(file) }
+  end
+
+  def test_load_yml_files
+    dir = Dir.mktmpdir
+    paths = (1..5).map do |i|
+      path = File.join(dir, "#{i}.yml")
+      File.write(path, "en:\n  foo: \"#{i}\"\n  file#{i}: yes\n")
+      path
+    end
+    backend = I18nema::Backend.new
+    assert_equal 5, backend.load_yml_files(paths, threads: 3)
+    assert_equal "5", backend.direct_lookup("en", "foo")
+    assert_equal true, backend.direct_lookup("en", "file1")
+
+    # anything read_yml can't do gets loaded on the calling thread, in order
+    File.write(paths[1], "en:\n  foo: &x \"two\"\n  bar: *x\n")
+    File.write(paths[2], "en:\n  bar: &y \"three\"\n  baz: *y\n")
+    backend = I18nema::Backend.new
+    assert_equal 7, backend.load_yml_files(paths, threads: 3)
+    assert_equal ["5", "three", "three"], %w{foo bar baz}.map { |key| backend.direct_lookup("en", key) }
+
+    File.write(paths[3], "en:\n  foo: \"lol\"\n\tbar: notabs!")
+    exception = assert_raise(I18nema::Backend::LoadError) {
+      I18nema::Backend.new.load_yml_files(paths, threads: 3)
+    }
+    assert_match(/syntax error/, exception.message)
+    assert_raise(Errno::ENOENT) {
+      I18nema::Backend.new.load_yml_files([File.join(dir, "nope.yml")])
+    }
+  ensure
+    FileUtils.rm_rf(dir) if dir
+  end
+
+  def test_reload_changed
+    dir = Dir.mktmpdir
+    paths = %w{a b c}.map { |name| File.join(dir, "#{name}.yml") }
+    File.write(paths[0], "en:\n  foo:\n    bar: a\n    baz: a\n  qux: a\n")
+    File.write(paths[1], "en:\n  foo:\n    bar: b\n")
+    File.write(paths[2], "en:\n  other: c\nes:\n  other: c\n")
+    load_path = I18n.load_path
+    I18n.load_path = paths.dup
+    backend = I18nema::Backend.new
+    backend.store_translations :en, stored: "yes"
+    backend.init_translations
+    assert_equal 0, backend.reload_changed!
+
+    File.write(paths[1], "en:\n  foo:\n    bar: B\n  more: B\n")
+    File.utime(Time.now + 10, Time.now + 10, paths[1])
+    assert_equal 2, backend.reload_changed! # b.yml, and a.yml since both have en.foo
+    assert_equal({bar: "B", baz: "a"}, backend.direct_lookup("en", "foo"))
+    assert_equal "B", backend.direct_lookup("en", "more")
+    assert_equal "a", backend.direct_lookup("en", "qux")
+    assert_equal "c", backend.direct_lookup("es", "other")
+    assert_equal "yes", backend.direct_lookup("en", "stored")
+
+    File.unlink(paths[2])
+    File.write(File.join(dir, "d.yml"), "fr:\n  other: d\n")
+    I18n.load_path << File.join(dir, "d.yml")
+    assert_equal 2, backend.reload_changed!
+    assert_equal nil, backend.direct_lookup("en", "other")
+    assert_equal "d", backend.direct_lookup("fr", "other")
+    assert_equal ['en', 'fr'], backend.available_locales.map(&:to_s).sort
+
+    File.write(paths[0], "en:\n  foo: \"lol\"\n\tbar: notabs!")
+    File.utime(Time.now + 20, Time.now + 20, paths[0])
+    assert_raise(I18nema::Backend::LoadError) { backend.reload_changed! }
+    assert_equal "a", backend.direct_lookup("en", "qux")
+
+    # yml strings only get re-parsed with keep_sources
+    I18n.load_path = [paths[1]]
+    [false, true].each_with_index do |keep, i|
+      backend = I18nema::Backend.new
+      backend.keep_sources = keep
+      backend.init_translations
+      backend.load_yml_string("en:\n  foo:\n    baz: string\n")
+      File.utime(Time.now + 30 + i, Time.now + 30 + i, paths[1])
+      assert_equal(keep ? 2 : nil, backend.reload_changed!)
+    end
+    assert_equal({bar: "B", baz: "string"}, backend.direct_lookup("en", "foo"))
+  ensure
+    I18n.load_path = load_path
+    FileUtils.rm_rf(dir) if dir
+  end
+
+  def test_reload_changed_same_second
+    dir = Dir.mktmpdir
+    path = File.join(dir, "a.yml")
+    now = Time.at(Time.now.to_i)
+    File.write(path, "en:\n  foo: bar\n")
+    File.utime(now + 0.1, now + 0.1, path)
+    load_path = I18n.load_path
+    I18n.load_path = [path]
+    backend = I18nema::Backend.new
+    backend.init_translations
+
+    File.write(path, "en:\n  foo: baz\n")
+    File.utime(now + 0.6, now + 0.6, path) # same second, same size
+    assert_equal 1, backend.reload_changed!
+    assert_equal "baz", backend.direct_lookup("en", "foo")
+  ensure
+    I18n.load_path = load_path
+    FileUtils.rm_rf(dir) if dir
+  end
+
+  def test_lazy_locales
+    dir = Dir.mktmpdir
+    paths = %w{a b}.map { |name| File.join(dir, "#{name}.yml") }
+    File.write(paths[0], "en:\n  foo: a\nfr:\n  foo: a\n")
+    File.write(paths[1], "---\n\"fr\":\n  bar: b\nde:\n  foo: b\n")
+    load_path = I18n.load_path
+    I18n.load_path = paths.dup
+    backend = I18nema::Backend.new
+    backend.lazy_locales = true
+    backend.init_translations
+    assert_equal({}, backend.stats[:locales])
+    assert_equal ['de', 'en', 'fr'], backend.available_locales.map(&:to_s).sort
+
+    assert_equal "a", backend.direct_lookup("en", "foo")
+    assert_equal [:en], backend.stats[:locales].keys
+    assert_equal "b", backend.translate(:fr, :bar)
+    assert_equal [:en, :fr], backend.stats[:locales].keys.sort
+
+    backend.preload_locales([:de])
+    assert_equal "b", backend.direct_lookup("de", "foo")
+    assert_equal ['de', 'en', 'fr'], backend.available_locales.map(&:to_s).sort
+
+    # a locale stays pending until all its files have loaded
+    File.write(File.join(dir, "c.yml"), "es:\n  foo: \"c\"\n\tbar: notabs!")
+    File.write(File.join(dir, "d.yml"), "es:\n  bar: d\n")
+    backend.load_translations(File.join(dir, "c.yml"), File.join(dir, "d.yml"))
+    assert_raise(I18nema::Backend::LoadError) { backend.direct_lookup("es", "bar") }
+    File.write(File.join(dir, "c.yml"), "es:\n  foo: c\n")
+    assert_equal "d", backend.direct_lookup("es", "bar")
+    assert_equal "c", backend.direct_lookup("es", "foo")
+
+    # only the wanted locale is kept (or counted)
+    File.write(paths[0], "en:\n  foo: a\nfr:\n" + (1..500).map { |i| "  key#{i}: value #{i}\n" }.join)
+    single = I18nema::Backend.new
+    assert_equal 1, single.send(:load_yml_file, paths[0], "en")
+    full = I18nema::Backend.new
+    full.send(:load_yml_file, paths[0])
+    assert_operator single.arena_usage[:bytes_allocated] * 4, :<, full.arena_usage[:bytes_allocated]
+  ensure
+    I18n.load_path = load_path
+    FileUtils.rm_rf(dir) if dir
+  end
+
   def test_merging
     @backend.store_translations :en, foo: "replaced!", wat: "added!"
     assert_equal "replaced!",
@@ -48,11 +623,112 @@ class I18nemaTest < Test::Unit::TestCase
                  @backend.direct_lookup("en", "wat")
   end
 
+  def test_store_translations
+    data = {"foo" => {baz: "hi %{name}", 1 => 2**70, list: [{a: 1.5}, :sym, nil, false]},
+            "a.b" => "dotted", time: Time.at(0).utc}
+    assert_equal 3, @backend.store_translations("en", data)
+    assert_equal({bar: "lol", baz: "hi %{name}", :"1" => 2**70, list: [{a: 1.5}, :sym, nil, false]},
+                 @backend.direct_lookup("en", "foo"))
+    assert_equal "hi bob", @backend.translate(:en, "foo.baz", name: "bob")
+    assert_equal "dotted", @backend.direct_lookup("en", "a.b")
+    assert_equal Time.at(0).utc.to_s, @backend.direct_lookup("en", "time")
+    @backend.store_translations :en, nul: "a\0b"
+    assert_equal "a\0b", @backend.direct_lookup("en", "nul")
+
+    nested = {}
+    nested[:loop] = nested
+    assert_raise(I18nema::Backend::LoadError) { @backend.store_translations :en, nested }
+    assert_equal "lol", @backend.direct_lookup("en", "foo", "bar")
+
+    dir = Dir.mktmpdir
+    path = File.join(dir, "en.yml")
+    File.write(path, "en:\n  foo:\n    bar: a\n")
+    load_path = I18n.load_path
+    I18n.load_path = [path]
+    backend = I18nema::Backend.new
+    backend.init_translations
+    backend.store_translations :en, foo: {baz: "stored"}
+    File.write(path, "en:\n  foo:\n    bar: b\n")
+    File.utime(Time.now + 10, Time.now + 10, path)
+    assert_nil backend.reload_changed! # nothing to merge the stored hash in again from
+    assert_equal "b", backend.translate(:en, "foo.bar")
+    assert_equal({bar: "b"}, backend.direct_lookup("en", "foo"))
+
+    backend.keep_sources = true
+    assert backend.keep_sources?
+    backend.store_translations :en, foo: {baz: "stored"}
+    File.write(path, "en:\n  foo:\n    bar: c\n")
+    File.utime(Time.now + 20, Time.now + 20, path)
+    assert_equal 2, backend.reload_changed! # the stored hash gets merged in again, too
+    assert_equal({bar: "c", baz: "stored"}, backend.direct_lookup("en", "foo"))
+  ensure
+    I18n.load_path = load_path if load_path
+    FileUtils.rm_rf(dir) if dir
+  end
+
   def test_reload
     @backend.reload!
     assert_equal({}, @backend.direct_lookup)
   end
 
+  def test_arena_usage
+    usage = @backend.arena_usage
+    assert_equal 1, usage[:arenas]
+    assert usage[:bytes_used] > 0
+    assert usage[:bytes_allocated] >= usage[:bytes_used]
+
+    assert_raise(I18nema::Backend::LoadError) { @backend.load_yml_string("string") }
+    assert_equal usage, @backend.arena_usage
+
+    @backend.reload!
+    assert_equal 0, @backend.arena_usage[:arenas]
+  end
+
+  def test_stats
+    require 'objspace'
+    @backend.store_translations :es, foo: {bar: "jaja"}
+    stats = @backend.stats
+    assert_equal 4, stats[:nodes][:string]
+    assert_equal 4, stats[:nodes][:hash]
+    assert_equal 2, stats[:nodes][:true]
+    assert_equal 17, stats[:string_bytes]
+    assert_equal 1, stats[:locales][:es][:nodes][:string]
+    assert_equal 4, stats[:locales][:es][:string_bytes]
+    assert_equal [1, 2, 2], stats[:levels].map { |level| level[:hashes] }
+    assert_equal 2, stats[:levels][0][:keys]
+    assert stats[:levels][0][:buckets] > 0
+
+    @backend.normalize_key("foo.bar", ".")
+    assert_equal 1, @backend.stats[:key_cache][:entries]
+    assert ObjectSpace.memsize_of(@backend.instance_variable_get(:@translations)) > @backend.arena_usage[:bytes_allocated]
+  end
+
+  def test_export_json
+    require 'json'
+    require 'stringio'
+    @backend.store_translations :en, quotes: "say \"hi\"\n\\ \u0001 caf\u00e9 %{name}"
+    assert_equal @backend.direct_lookup("en").to_json, @backend.export_json(:en)
+    assert_equal({"bar" => "lol"}, JSON.parse(@backend.export_json(:en, "foo")))
+    assert_equal({"bar" => "lol"}, JSON.parse(@backend.export_json(:en, :foo, only: [:bar, :nope])))
+    assert_equal '{"quotes":' + @backend.direct_lookup("en", "quotes").to_json + ',"baz":["asdf","qwerty"]}',
+                 @backend.export_json(:en, only: %w{quotes baz})
+    assert_equal nil, @backend.export_json(:fr)
+
+    big = Hash[(1..2000).map { |i| ["key#{i}", "value #{i}" * 3] }]
+    @backend.store_translations :en, big: big
+    io = StringIO.new
+    assert_equal @backend.export_json(:en).bytesize, @backend.export_json_to(io, :en)
+    assert_equal @backend.direct_lookup("en").to_json, io.string
+
+    path = File.join(Dir.tmpdir, "i18nema_test_#{$$}.snapshot")
+    @backend.dump_snapshot(path)
+    backend = I18nema::Backend.new
+    backend.load_snapshot(path)
+    assert_equal @backend.export_json(:en), backend.export_json(:en)
+  ensure
+    File.unlink(path) if path && File.exist?(path)
+  end
+
   def test_available_locales
     @backend.store_translations :es, foo: "hola"
     assert_equal ['en', 'es'],
@@ -79,6 +755,53 @@ class I18nemaTest < Test::Unit::TestCase
     }
     assert_match(/bad anchor `a'/, exception.message)
     assert_equal({}, backend.direct_lookup)
+
+    assert_raise(I18nema::Backend::LoadError) { backend.load_yml_string("en:\n  ? [a, b]\n  : c\n") }
+    assert_equal({}, backend.direct_lookup)
+  end
+
+  def test_syck_aliases
+    backend = I18nema::Backend.new
+    backend.load_yml_string "en:\n  list:\n  - &x one\n  - *x\n  - *x\n  *x : aliased key\n  true: yes\n  ~: nil key\n  other: [yes, no]\n"
+    assert_equal({list: ["one", "one", "one"], one: "aliased key", true: true, :"" => "nil key", other: [true, false]},
+                 backend.direct_lookup("en"))
+  end
+
+  def test_yml_subset
+    backend = I18nema::Backend.new
+    backend.load_yml_string <<-YML
+---
+en: # comment
+  plain: it's C# # comment
+  quoted: 'it''s "quoted"'
+  escaped: "tab\there"
+  "quoted key": "%{count} things"
+  :symbol_key: :symbol
+  1: 2
+  float: 1.5
+  toggles: [yes, Off, ~, 'no']
+  literal: |
+    one
+      two
+
+    three
+  folded: >-
+    one
+    two
+  list:
+  - a
+  -
+    nested: b
+  empty:
+    YML
+    assert_equal({plain: "it's C#", quoted: 'it\'s "quoted"', escaped: "tab\there", :"quoted key" => "%{count} things",
+                  symbol_key: :symbol, :"1" => 2, float: 1.5, toggles: [true, false, nil, "no"],
+                  literal: "one\n  two\n\nthree\n", folded: "one two", list: ["a", {nested: "b"}], empty: nil},
+                 backend.direct_lookup("en"))
+
+    # anything fancier is left to syck
+    backend.load_yml_string("en:\n  foo: &foo bar\n  baz: *foo\n")
+    assert_equal "bar", backend.direct_lookup("en", "baz")
   end
 
   def test_normalize_key
@@ -94,4 +817,19 @@ class I18nemaTest < Test::Unit::TestCase
     assert_equal %w{asdf asdf asdf},
                  backend.normalize_key(%w{asdf asdf.asdf}, ".")
   end
+
+  private
+
+  # same as snapshot_checksum in the extension
+  def snapshot_checksum(data)
+    mask = (1 << 64) - 1
+    hash = 14695981039346656037
+    words = data.bytesize / 8
+    data.unpack("Q<#{words}").each do |word|
+      hash = ((hash ^ word) * 1099511628211) & mask
+      hash ^= hash >> 32
+    end
+    data.byteslice(words * 8..-1).each_byte { |byte| hash = ((hash ^ byte) * 1099511628211) & mask }
+    hash
+  end
 end